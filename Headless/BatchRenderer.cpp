@@ -0,0 +1,173 @@
+/*
+  ==============================================================================
+
+    Renders many MIDI files at once, one engine per job, on every core.
+
+  ==============================================================================
+*/
+
+#include "BatchRenderer.h"
+#include "../Source/WorkerPool.h"
+#include <algorithm>
+#include <mutex>
+#include <numeric>
+
+BatchRenderer::BatchRenderer(const BatchSettings &s)
+    : settings(s), numThreads(s.numThreads > 0
+                                  ? s.numThreads
+                                  : juce::SystemStats::getNumCpus()) {}
+
+bool BatchRenderer::readManifest(const juce::File &manifest,
+                                 std::vector<BatchJob> &jobs,
+                                 juce::String &error) {
+  juce::StringArray lines;
+  manifest.readLines(lines);
+  const auto directory = manifest.getParentDirectory();
+  for (int i = 0; i < lines.size(); i++) {
+    const auto line = lines[i].trim();
+    if (line.isEmpty() || line.startsWithChar('#')) {
+      continue;
+    }
+    auto fields = juce::StringArray::fromTokens(line, ",", "\"");
+    fields.trim();
+    if (fields.size() != 3 || fields[0].isEmpty() || fields[1].isEmpty() ||
+        !fields[1].containsOnly("0123456789") || fields[2].isEmpty()) {
+      error = manifest.getFileName() + ":" + juce::String(i + 1) +
+              ": expected <MIDI file>,<patch index>,<output file>";
+      return false;
+    }
+    BatchJob job;
+    job.midi = directory.getChildFile(fields[0].unquoted());
+    job.patch = fields[1].getIntValue();
+    job.out = directory.getChildFile(fields[2].unquoted());
+    jobs.push_back(job);
+  }
+  if (jobs.empty()) {
+    error = "No jobs in " + manifest.getFullPathName();
+    return false;
+  }
+  return true;
+}
+
+//==============================================================================
+std::vector<BatchResult>
+BatchRenderer::run(const std::vector<BatchJob> &jobs) {
+  const int numJobs = (int)jobs.size();
+  const int threads = juce::jlimit(1, juce::jmax(1, numJobs), numThreads);
+
+  // Longest first by file size, so no engine is left with a long file while
+  // the others run out of work.
+  std::vector<juce::int64> sizes;
+  for (const auto &job : jobs) {
+    sizes.push_back(job.midi.getSize());
+  }
+  std::vector<int> order((size_t)numJobs);
+  std::iota(order.begin(), order.end(), 0);
+  std::stable_sort(order.begin(), order.end(),
+                   [&](int a, int b) { return sizes[a] > sizes[b]; });
+
+  // One encoder keeps up with a few engines.
+  std::vector<std::unique_ptr<juce::TimeSliceThread>> writers;
+  for (int w = 0; w < (threads + 3) / 4; w++) {
+    writers.push_back(
+        std::make_unique<juce::TimeSliceThread>("GS1 batch writer"));
+    writers.back()->startThread();
+  }
+
+  std::vector<BatchResult> results((size_t)numJobs);
+  std::mutex printLock;
+  int numDone = 0;
+  auto renderJob = [&](int index) {
+    const int j = order[(size_t)index];
+    results[(size_t)j] =
+        render(jobs[(size_t)j], *writers[(size_t)index % writers.size()]);
+
+    const std::lock_guard<std::mutex> lock(printLock);
+    const auto &result = results[(size_t)j];
+    const auto path = result.out.getFullPathName();
+    numDone++;
+    if (result.error.isNotEmpty()) {
+      std::printf("[%d/%d] %s: FAILED, %s\n", numDone, numJobs,
+                  path.toRawUTF8(), result.error.toRawUTF8());
+    } else {
+      std::printf("[%d/%d] %s: %.2f s of audio in %.3f s (%.2fx realtime, "
+                  "%.3f s writer wait)\n",
+                  numDone, numJobs, path.toRawUTF8(), result.audioSeconds,
+                  result.renderSeconds,
+                  result.audioSeconds / result.renderSeconds,
+                  result.waitSeconds);
+    }
+    std::fflush(stdout);
+  };
+
+  const auto start = juce::Time::getHighResolutionTicks();
+  WorkerPool pool(threads - 1);
+  for (int first = 0; first < numJobs; first += WorkerPool::maxJobs) {
+    auto renderChunk = [&](int index) { renderJob(first + index); };
+    pool.run(juce::jmin(WorkerPool::maxJobs, numJobs - first), renderChunk);
+  }
+  const double elapsed = juce::Time::highResolutionTicksToSeconds(
+      juce::Time::getHighResolutionTicks() - start);
+
+  int numFailed = 0;
+  double audioSeconds = 0;
+  for (const auto &result : results) {
+    numFailed += result.error.isNotEmpty() ? 1 : 0;
+    audioSeconds += result.audioSeconds;
+  }
+  const double realtime = audioSeconds / elapsed;
+  std::printf("%d jobs, %d failed: %.2f s of audio in %.3f s on %d threads "
+              "(%.2fx realtime, %.2fx per thread)\n",
+              numJobs, numFailed, audioSeconds, elapsed, threads, realtime,
+              realtime / threads);
+  return results;
+}
+
+BatchResult BatchRenderer::render(const BatchJob &job,
+                                  juce::TimeSliceThread &writerThread) {
+  BatchResult result;
+  result.out = job.out;
+  const auto start = juce::Time::getHighResolutionTicks();
+
+  const auto sequence = HeadlessRenderer::loadMidiFile(job.midi);
+  if (sequence.getNumEvents() == 0) {
+    result.error = "could not read MIDI file " + job.midi.getFullPathName();
+    return result;
+  }
+  job.out.getParentDirectory().createDirectory();
+  auto writer = HeadlessRenderer::createWriter(
+      job.out, settings.render.sampleRate, settings.bitsPerSample);
+  if (writer == nullptr) {
+    result.error = "could not write " + job.out.getFullPathName();
+    return result;
+  }
+
+  auto renderSettings = settings.render;
+  renderSettings.patch = job.patch;
+  HeadlessRenderer renderer(renderSettings);
+
+  const int ringSamples =
+      juce::jmax(renderSettings.blockSize * 2,
+                 (int)(settings.bufferSeconds * renderSettings.sampleRate));
+  juce::int64 waitTicks = 0;
+  juce::int64 numSamples;
+  {
+    juce::AudioFormatWriter::ThreadedWriter ring(writer.release(),
+                                                 writerThread, ringSamples);
+    numSamples =
+        renderer.render(sequence, [&](const juce::AudioBuffer<float> &block) {
+          while (!ring.write(block.getArrayOfReadPointers(),
+                             block.getNumSamples())) {
+            const auto waitStart = juce::Time::getHighResolutionTicks();
+            juce::Thread::sleep(1);
+            waitTicks += juce::Time::getHighResolutionTicks() - waitStart;
+          }
+        });
+  } // Writes out what is left in the ring and closes the file.
+
+  result.audioSeconds = (double)numSamples / renderSettings.sampleRate;
+  result.renderSeconds = juce::Time::highResolutionTicksToSeconds(
+      juce::Time::getHighResolutionTicks() - start);
+  result.waitSeconds = juce::Time::highResolutionTicksToSeconds(waitTicks);
+  return result;
+}
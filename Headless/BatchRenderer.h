@@ -0,0 +1,63 @@
+/*
+  ==============================================================================
+
+    Renders many MIDI files at once, one engine per job, on every core.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include "HeadlessRenderer.h"
+#include <JuceHeader.h>
+
+struct BatchJob {
+  juce::File midi;
+  int patch = 0;
+  juce::File out; // WAV or FLAC, see HeadlessRenderer::createWriter().
+};
+
+struct BatchSettings {
+  RenderSettings render; // For every job, except the patch.
+  int bitsPerSample = 24;
+  int numThreads = 0;        // Engines rendering at once, 0 for every core.
+  double bufferSeconds = 2.0; // Audio each job may queue for its writer.
+};
+
+struct BatchResult {
+  juce::File out;
+  juce::String error; // Empty if the job succeeded.
+  double audioSeconds = 0;
+  double renderSeconds = 0; // Wall time of the job.
+  double waitSeconds = 0;   // Part of it spent waiting for the writer.
+};
+
+//==============================================================================
+// Jobs are claimed from one shared queue, longest MIDI file first, by a
+// WorkerPool with a thread per engine; each engine renders single threaded.
+// Blocks go to the file through an AudioFormatWriter::ThreadedWriter, a ring
+// of bufferSeconds per job drained by writer threads, so encoding overlaps
+// rendering and memory stays flat however long a file is. A job whose ring
+// is full waits for it.
+class BatchRenderer {
+public:
+  explicit BatchRenderer(const BatchSettings &settings);
+
+  // One job per line: <MIDI file>,<patch index>,<output file>. Relative paths
+  // are relative to the manifest; blank lines and lines starting with # are
+  // skipped. Returns false and sets error on the first bad line.
+  static bool readManifest(const juce::File &manifest,
+                           std::vector<BatchJob> &jobs, juce::String &error);
+
+  // Renders every job and prints a line per job as it finishes, then the
+  // totals. Returns one result per job, in manifest order.
+  std::vector<BatchResult> run(const std::vector<BatchJob> &jobs);
+
+  int getNumThreads() const { return numThreads; }
+
+private:
+  BatchResult render(const BatchJob &job, juce::TimeSliceThread &writer);
+
+  BatchSettings settings;
+  int numThreads;
+};
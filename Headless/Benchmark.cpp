@@ -0,0 +1,462 @@
+/*
+  ==============================================================================
+
+    Repeatable engine timings for the headless build.
+
+  ==============================================================================
+*/
+
+#include "Benchmark.h"
+#include "../Source/Tables.h"
+
+static double ticksToSeconds(juce::int64 ticks) {
+  return juce::Time::highResolutionTicksToSeconds(ticks);
+}
+
+// Makes the compiler keep the work that produced value.
+static void doNotOptimize(int value) {
+#if defined(__GNUC__)
+  asm volatile("" : : "r"(value));
+#else
+  static volatile int sink;
+  sink = value;
+#endif
+}
+
+// Distinct held notes between C2 and B5 on channel 1, then on the other
+// channels, then outside that range.
+static int benchNote(int index) {
+  const int note = (index * 7) % 48;
+  if (index < 768) {
+    return 36 + note;
+  }
+  return note < 36 ? note : note + 48;
+}
+static int benchChannel(int index) { return 1 + index / 48 % 16; }
+
+static const char *isaNames[] = {"scalar", "sse41", "avx2", "avx512"};
+
+bool parseKernelIsa(const juce::String &name, FMKernelIsa &isa) {
+  if (name == "scalar") {
+    isa = FMKernelIsa::scalar;
+    return true;
+  }
+  if (name == "sse41") {
+    isa = FMKernelIsa::sse41;
+    return juce::SystemStats::hasSSE41();
+  }
+  if (name == "avx2") {
+    isa = FMKernelIsa::avx2;
+    return juce::SystemStats::hasAVX2();
+  }
+  if (name == "avx512") {
+    isa = FMKernelIsa::avx512;
+    return juce::SystemStats::hasAVX512F();
+  }
+  return false;
+}
+
+static const char *lookupNames[] = {"two-stage", "fused-exp", "fused-quarter",
+                                    "fused-full", "shuffle"};
+
+bool parseKernelLookup(const juce::String &name, FMLookup &lookup) {
+  for (int i = 0; i < (int)std::size(lookupNames); i++) {
+    if (name == lookupNames[i]) {
+      lookup = (FMLookup)i;
+      return true;
+    }
+  }
+  return false;
+}
+
+Benchmark::Benchmark(const BenchmarkSettings &s) : settings(s) {}
+
+BenchmarkResult Benchmark::measure(const juce::String &label, int patch,
+                                   int ch1Mode, int ch2Mode, int voices,
+                                   const juce::String &isa,
+                                   int renderThreads,
+                                   const juce::String &lookup,
+                                   BenchPitch pitch, bool noteCache,
+                                   int polyphony) {
+  BenchmarkResult result;
+  result.label = label;
+  result.voices = voices;
+
+  GS1_juceAudioProcessor processor;
+  FMKernelIsa kernelIsa;
+  if (parseKernelIsa(isa.isNotEmpty() ? isa : settings.isa, kernelIsa)) {
+    processor.setKernelIsa(kernelIsa);
+  }
+  FMLookup kernelLookup;
+  if (parseKernelLookup(lookup.isNotEmpty() ? lookup : settings.lookup,
+                        kernelLookup)) {
+    processor.setKernelLookup(kernelLookup);
+  }
+  processor.setRenderThreads(renderThreads >= 0 ? renderThreads
+                                                : settings.renderThreads);
+  processor.setCurrentProgram(patch);
+  processor.setFMModes(ch1Mode, ch2Mode);
+  if (polyphony > 0) {
+    processor.setPolyphony(polyphony);
+  }
+  processor.setRateAndBufferSizeDetails(settings.sampleRate,
+                                        settings.blockSize);
+  processor.prepareToPlay(settings.sampleRate, settings.blockSize);
+  if (noteCache) {
+    // Every bench note, held through the warm-up and the measurement.
+    NoteCacheSettings cache;
+    cache.seconds = settings.seconds + 0.5;
+    cache.velocityLayers = 1;
+    cache.lowKey = 36;
+    cache.highKey = 83;
+    processor.enableNoteCache(cache);
+  }
+
+  juce::AudioBuffer<float> buffer(2, settings.blockSize);
+  juce::MidiBuffer midi;
+  for (int v = 0; v < voices; v++) {
+    midi.addEvent(juce::MidiMessage::noteOn(benchChannel(v), benchNote(v),
+                                            (juce::uint8)100),
+                  0);
+  }
+  if (pitch == BenchPitch::vibrato) {
+    midi.addEvent(juce::MidiMessage::controllerEvent(1, 1, 127), 0);
+  }
+  processor.processBlock(buffer, midi);
+  midi.clear();
+
+  // Every voice sees a new pitch each block.
+  int wheel = 0;
+  auto moveWheel = [&] {
+    if (pitch == BenchPitch::bend) {
+      wheel = (wheel + 1021) & 16383;
+      midi.clear();
+      midi.addEvent(juce::MidiMessage::pitchWheel(1, wheel), 0);
+    }
+  };
+
+  // Let the attacks settle so every block sees the same voice load.
+  const int warmupBlocks =
+      juce::jmax(1, (int)(0.1 * settings.sampleRate) / settings.blockSize);
+  for (int b = 0; b < warmupBlocks; b++) {
+    buffer.clear();
+    moveWheel();
+    processor.processBlock(buffer, midi);
+  }
+
+  const int numBlocks = juce::jmax(
+      1, (int)std::ceil(settings.seconds * settings.sampleRate /
+                        settings.blockSize));
+  const double numSamples = (double)numBlocks * settings.blockSize;
+
+  const auto start = juce::Time::getHighResolutionTicks();
+  for (int b = 0; b < numBlocks; b++) {
+    buffer.clear();
+    moveWheel();
+    processor.processBlock(buffer, midi);
+  }
+  const double elapsed =
+      ticksToSeconds(juce::Time::getHighResolutionTicks() - start);
+
+  result.realtimeFactor = numSamples / settings.sampleRate / elapsed;
+  result.nsPerSample = elapsed * 1e9 / numSamples;
+  result.nsPerVoiceSample = result.nsPerSample / voices;
+
+  // The FM core on its own, over the voices that were just triggered.
+  const int kernelSamples = (int)numSamples;
+  int sum = 0;
+  const auto kernelStart = juce::Time::getHighResolutionTicks();
+  for (int i = 0; i < kernelSamples; i++) {
+    for (int v = 0; v < voices; v++) {
+      sum += processor.fmGenSample(processor.voiceStates[v]);
+    }
+  }
+  const double kernelElapsed =
+      ticksToSeconds(juce::Time::getHighResolutionTicks() - kernelStart);
+  result.kernelNsPerVoiceSample =
+      kernelElapsed * 1e9 / ((double)kernelSamples * voices);
+
+  doNotOptimize(sum); // The kernel loop.
+
+  return result;
+}
+
+//==============================================================================
+void Benchmark::run() {
+  static const char *modeNames[] = {"NORM", "PI/2", "PI", "CROSS"};
+
+  if (settings.only == "micro") {
+    runMicro();
+    return;
+  }
+
+  if (settings.csv) {
+    std::printf("section,label,voices,realtime_factor,ns_per_sample,"
+                "ns_per_voice_sample,kernel_ns_per_voice_sample\n");
+  }
+
+  if (settings.only.isEmpty() || settings.only == "voices") {
+    printHeader("voices");
+    for (int voices = 1; voices <= GS1_juceAudioProcessor::defaultPolyphony;
+         voices++) {
+      print(measure("voices", 0, 0, 0, voices));
+    }
+  }
+
+  if (settings.only.isEmpty() || settings.only == "fm") {
+    printHeader("fm");
+    for (int m1 = 0; m1 < 4; m1++) {
+      for (int m2 = 0; m2 < 4; m2++) {
+        print(measure(juce::String(modeNames[m1]) + "+" + modeNames[m2], 0, m1,
+                      m2, GS1_juceAudioProcessor::defaultPolyphony));
+      }
+    }
+  }
+
+  if (settings.only.isEmpty() || settings.only == "patches") {
+    printHeader("patches");
+    GS1_juceAudioProcessor names;
+    for (int p = 0; p < names.getNumPrograms(); p++) {
+      print(measure(names.getProgramName(p), p, 0, 0,
+                    GS1_juceAudioProcessor::defaultPolyphony));
+    }
+  }
+
+  if (settings.only.isEmpty() || settings.only == "kernels") {
+    printHeader("kernels");
+    for (auto *name : isaNames) {
+      FMKernelIsa isa;
+      if (parseKernelIsa(name, isa)) {
+        print(measure(name, 0, 0, 0, GS1_juceAudioProcessor::defaultPolyphony,
+                      name));
+      }
+    }
+  }
+
+  if (settings.only.isEmpty() || settings.only == "lookups") {
+    printHeader("lookups");
+    for (auto *isaName : isaNames) {
+      FMKernelIsa isa;
+      if (!parseKernelIsa(isaName, isa)) {
+        continue;
+      }
+      for (auto *lookupName : lookupNames) {
+        FMLookup lookup;
+        parseKernelLookup(lookupName, lookup);
+        if (getFMKernel(isa, lookup).lookup == lookup) {
+          print(measure(juce::String(isaName) + " " + lookupName, 0, 0, 0,
+                        GS1_juceAudioProcessor::defaultPolyphony, isaName, -1,
+                        lookupName));
+        }
+      }
+    }
+  }
+
+  if (settings.only.isEmpty() || settings.only == "pitch") {
+    printHeader("pitch");
+    const char *pitchNames[] = {"static", "vibrato", "bend"};
+    for (int p = 0; p < (int)std::size(pitchNames); p++) {
+      print(measure(pitchNames[p], 0, 0, 0,
+                    GS1_juceAudioProcessor::defaultPolyphony, {}, -1, {},
+                    (BenchPitch)p));
+    }
+  }
+
+  if (settings.only.isEmpty() || settings.only == "cache") {
+    printHeader("cache");
+    print(measure("live", 0, 0, 0, GS1_juceAudioProcessor::defaultPolyphony));
+    print(measure("cached", 0, 0, 0, GS1_juceAudioProcessor::defaultPolyphony,
+                  {}, -1, {}, BenchPitch::none, true));
+  }
+
+  if (settings.only.isEmpty() || settings.only == "threads") {
+    printHeader("threads");
+    // 32 voices make at most four slices of eight.
+    const int maxThreads = juce::jmin(juce::SystemStats::getNumCpus() - 1, 3);
+    for (int threads = 0; threads <= maxThreads; threads++) {
+      print(measure(juce::String(threads) + " threads", 0, 0, 0,
+                    GS1_juceAudioProcessor::defaultPolyphony, {}, threads));
+    }
+  }
+
+  if (settings.only.isEmpty() || settings.only == "polyphony") {
+    printHeader("polyphony");
+    // Every voice of the pool sounding, so the cost per voice sample shows
+    // how the engine scales past the default.
+    for (int polyphony = GS1_juceAudioProcessor::minPolyphony;
+         polyphony <= GS1_juceAudioProcessor::maxPolyphony; polyphony *= 2) {
+      print(measure(juce::String(polyphony) + " voices", 0, 0, 0, polyphony,
+                    {}, -1, {}, BenchPitch::none, false, polyphony));
+    }
+  }
+}
+
+// Calls fn until a slice of the row time has passed, then returns the cost
+// of one of the opsPerCall operations a call does.
+template <class Fn>
+static double timeOps(double seconds, int opsPerCall, Fn fn) {
+  juce::int64 calls = 0;
+  const auto start = juce::Time::getHighResolutionTicks();
+  double elapsed = 0;
+  do {
+    for (int i = 0; i < 64; i++) {
+      fn();
+    }
+    calls += 64;
+    elapsed = ticksToSeconds(juce::Time::getHighResolutionTicks() - start);
+  } while (elapsed < seconds);
+  return elapsed * 1e9 / ((double)calls * opsPerCall);
+}
+
+void Benchmark::runMicro() {
+  currentSection = "micro";
+  if (settings.csv) {
+    std::printf("section,label,ns_per_op,op\n");
+  } else {
+    std::printf("\n== micro (%.2f s per row)\n", settings.seconds / 4);
+  }
+  const double seconds = settings.seconds / 4;
+
+  int sum = 0;
+  printMicro("lookupSin", timeOps(seconds, 1024, [&] {
+               for (int val = 0; val < 1024; val++) {
+                 sum += lookupSin(val);
+               }
+             }),
+             "lookup");
+  printMicro("lookupExp", timeOps(seconds, 4096, [&] {
+               for (int val = 0; val < 0x10000; val += 16) {
+                 sum += lookupExp(val);
+               }
+             }),
+             "lookup");
+
+  // Held voices of the default patch, at the engine rate.
+  GS1_juceAudioProcessor processor;
+  processor.prepareToPlay(34687, settings.blockSize);
+  juce::AudioBuffer<float> buffer(2, settings.blockSize);
+  juce::MidiBuffer midi;
+  const int numVoices = GS1_juceAudioProcessor::defaultPolyphony;
+  for (int v = 0; v < numVoices; v++) {
+    midi.addEvent(juce::MidiMessage::noteOn(1, benchNote(v), (juce::uint8)100),
+                  0);
+  }
+  processor.processBlock(buffer, midi);
+
+  printMicro("fmGenSample", timeOps(seconds, 32, [&] {
+               for (int s = 0; s < 32; s++) {
+                 sum += processor.fmGenSample(processor.voiceStates[s & 7]);
+               }
+             }),
+             "voice-sample");
+
+  auto lanes = std::make_unique<FMLanes>();
+  auto amps = std::make_unique<FMAmpBlock>();
+  lanes->numLanes = FMLanes::maxLanes;
+  for (int v = 0; v < FMLanes::maxLanes; v++) {
+    for (int n = 0; n < 4; n++) {
+      lanes->CW[n][v] = processor.voiceStates[v % numVoices].CW[n];
+    }
+  }
+  for (auto &sample : amps->amp) {
+    for (auto &op : sample) {
+      for (int v = 0; v < FMLanes::maxLanes; v++) {
+        op[v] = (v * 97) & 1023; // Sounding, varied levels.
+      }
+    }
+  }
+  int32_t out[FMAmpBlock::maxSamples];
+  for (auto *isaName : isaNames) {
+    FMKernelIsa isa;
+    if (!parseKernelIsa(isaName, isa)) {
+      continue;
+    }
+    for (auto *lookupName : lookupNames) {
+      FMLookup lookup;
+      parseKernelLookup(lookupName, lookup);
+      const FMKernel kernel = getFMKernel(isa, lookup);
+      if (kernel.lookup != lookup) {
+        continue;
+      }
+      const FMKernelFn render = kernel.render[0][0];
+      printMicro(juce::String("kernel ") + isaName + " " + lookupName,
+                 timeOps(seconds, FMLanes::maxLanes * FMAmpBlock::maxSamples,
+                         [&] {
+                           render(*lanes, *amps, FMAmpBlock::maxSamples, out);
+                           sum += out[0];
+                         }),
+                 "voice-sample");
+    }
+  }
+
+  int32_t envelopeAmps[4 * FMAmpBlock::maxSamples];
+  printMicro("envelopes", timeOps(seconds, FMAmpBlock::maxSamples, [&] {
+               processor.voiceStates[0].envelopes.render(
+                   true, FMAmpBlock::maxSamples, envelopeAmps, 1, 4);
+               sum += envelopeAmps[0];
+             }),
+             "voice-sample");
+
+  const int blockSize = settings.blockSize;
+  std::vector<float> input(blockSize), left(blockSize), right(blockSize);
+  for (int i = 0; i < blockSize; i++) {
+    input[i] = std::sin(i * 0.05f);
+  }
+  Chorus chorus;
+  chorus.prepare(34687);
+  printMicro("chorus", timeOps(seconds, blockSize, [&] {
+               chorus.process(input.data(), left.data(), right.data(),
+                              blockSize);
+             }),
+             "sample");
+
+  Resampler resampler;
+  resampler.prepare(34687, settings.sampleRate, blockSize, 2);
+  std::vector<float> outLeft(blockSize), outRight(blockSize);
+  float *outputs[] = {outLeft.data(), outRight.data()};
+  printMicro("resampler", timeOps(seconds, blockSize, [&] {
+               const int needed = resampler.getInputSamplesNeeded(blockSize);
+               for (int c = 0; c < 2; c++) {
+                 std::fill_n(resampler.getInputPointer(c), needed, 0.25f);
+               }
+               resampler.process(outputs, blockSize);
+             }),
+             "stereo output sample");
+
+  doNotOptimize(sum);
+}
+
+void Benchmark::printMicro(const juce::String &label, double nsPerOp,
+                           const char *unit) {
+  if (settings.csv) {
+    std::printf("micro,%s,%.3f,%s\n", label.toRawUTF8(), nsPerOp, unit);
+  } else {
+    std::printf("%-28s %10.3f ns/%s\n", label.toRawUTF8(), nsPerOp, unit);
+  }
+  std::fflush(stdout);
+}
+
+void Benchmark::printHeader(const juce::String &section) {
+  currentSection = section;
+  if (settings.csv) {
+    return;
+  }
+  std::printf("\n== %s (%.0f Hz, block %d, %.1f s per row)\n",
+              section.toRawUTF8(), settings.sampleRate, settings.blockSize,
+              settings.seconds);
+  std::printf("%-20s %6s %10s %12s %16s %16s\n", "label", "voices",
+              "x realtime", "ns/sample", "ns/voice-sample", "kernel ns/v-s");
+}
+
+void Benchmark::print(const BenchmarkResult &r) {
+  if (settings.csv) {
+    std::printf("%s,%s,%d,%.3f,%.2f,%.2f,%.2f\n", currentSection.toRawUTF8(),
+                r.label.toRawUTF8(), r.voices, r.realtimeFactor, r.nsPerSample,
+                r.nsPerVoiceSample, r.kernelNsPerVoiceSample);
+  } else {
+    std::printf("%-20s %6d %10.2f %12.2f %16.2f %16.2f\n",
+                r.label.toRawUTF8(), r.voices, r.realtimeFactor,
+                r.nsPerSample, r.nsPerVoiceSample, r.kernelNsPerVoiceSample);
+  }
+  std::fflush(stdout);
+}
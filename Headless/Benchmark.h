@@ -0,0 +1,81 @@
+/*
+  ==============================================================================
+
+    Repeatable engine timings for the headless build.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include "../Source/PluginProcessor.h"
+#include <JuceHeader.h>
+
+struct BenchmarkSettings {
+  double sampleRate = 48000.0;
+  int blockSize = 512;
+  double seconds = 2.0; // Audio rendered per measurement.
+  bool csv = false;
+  juce::String only; // "voices", "fm", "patches", "kernels", "lookups",
+                     // "pitch", "cache", "threads" or "polyphony"; empty
+                     // runs all of them. "micro" runs the microbenchmarks
+                     // instead.
+  juce::String isa;  // FM kernel, see parseKernelIsa(). Empty picks the
+                     // widest one the CPU supports.
+  juce::String lookup; // See parseKernelLookup(). Empty is two-stage.
+  int renderThreads = 0; // Used by every section except "threads".
+};
+
+// "scalar", "sse41", "avx2" or "avx512". False for unknown names and for
+// instruction sets this CPU lacks.
+bool parseKernelIsa(const juce::String &name, FMKernelIsa &isa);
+
+// "two-stage", "fused-exp", "fused-quarter", "fused-full" or "shuffle".
+// False for unknown names.
+bool parseKernelLookup(const juce::String &name, FMLookup &lookup);
+
+// Pitch modulation during a measurement: none, vibrato from a full mod
+// wheel, or a pitch wheel that moves every block.
+enum class BenchPitch { none, vibrato, bend };
+
+struct BenchmarkResult {
+  juce::String label;
+  int voices = 0;
+  double realtimeFactor = 0;   // Audio seconds rendered per wall second.
+  double nsPerSample = 0;      // processBlock cost per output sample.
+  double nsPerVoiceSample = 0; // The same, divided by the sounding voices.
+  double kernelNsPerVoiceSample = 0; // Scalar fmGenSample alone.
+};
+
+//==============================================================================
+class Benchmark {
+public:
+  explicit Benchmark(const BenchmarkSettings &settings);
+
+  // Runs the voice-count, FM-mode, patch, kernel, operator lookup, pitch
+  // modulation, note cache, render thread and polyphony sweeps and prints
+  // the results.
+  void run();
+
+  // Each DSP building block on its own: table lookups, the per-voice and
+  // block FM kernels with every operator lookup, envelopes, chorus and
+  // resampler.
+  void runMicro();
+
+  BenchmarkResult measure(const juce::String &label, int patch, int ch1Mode,
+                          int ch2Mode, int voices,
+                          const juce::String &isa = {},
+                          int renderThreads = -1,
+                          const juce::String &lookup = {},
+                          BenchPitch pitch = BenchPitch::none,
+                          bool noteCache = false, int polyphony = 0);
+
+private:
+  void print(const BenchmarkResult &result);
+  void printHeader(const juce::String &section);
+  void printMicro(const juce::String &label, double nsPerOp,
+                  const char *unit);
+
+  BenchmarkSettings settings;
+  juce::String currentSection;
+};
@@ -0,0 +1,257 @@
+/*
+  ==============================================================================
+
+    Drives GS1_juceAudioProcessor without a host, from a MIDI sequence to
+    plain audio buffers.
+
+  ==============================================================================
+*/
+
+#include "HeadlessRenderer.h"
+#include <algorithm>
+
+HeadlessRenderer::HeadlessRenderer(const RenderSettings &s) : settings(s) {
+  if (settings.bank != juce::File()) {
+    processor.loadBank(settings.bank);
+  }
+  processor.setCurrentProgram(settings.patch);
+  processor.setFMModes(settings.fmModes[0], settings.fmModes[1]);
+  processor.setRenderThreads(settings.renderThreads);
+  processor.setKernelLookup(settings.lookup);
+  processor.setPolyphony(settings.polyphony);
+  if (settings.noteCache) {
+    processor.enableNoteCache(settings.cacheSettings);
+  }
+  processor.setRateAndBufferSizeDetails(settings.sampleRate,
+                                        settings.blockSize);
+  processor.prepareToPlay(settings.sampleRate, settings.blockSize);
+  buffer.setSize(2, settings.blockSize);
+  engineState.setSize(processor.getEngineStateSize());
+}
+
+juce::int64 HeadlessRenderer::render(
+    const juce::MidiMessageSequence &sequence,
+    const std::function<void(const juce::AudioBuffer<float> &)> &sink,
+    juce::int64 startSample) {
+  const double endTime =
+      (sequence.getNumEvents() > 0 ? sequence.getEndTime() : 0.0) +
+      settings.tailSeconds;
+  const auto totalSamples =
+      (juce::int64)std::ceil(endTime * settings.sampleRate);
+
+  // Blocks always start at multiples of the block size, so that a resumed
+  // render cuts the audio exactly like a full one.
+  const juce::int64 blockSize = settings.blockSize;
+  const juce::int64 firstBlock =
+      juce::jlimit<juce::int64>(0, totalSamples, startSample) / blockSize *
+      blockSize;
+  const bool checkpoints = settings.checkpoints != juce::File();
+  const juce::int64 interval =
+      juce::jmax<juce::int64>(
+          1, juce::roundToInt(settings.checkpointSeconds *
+                              settings.sampleRate / (double)blockSize)) *
+      blockSize;
+  const auto key = checkpoints ? getCheckpointKey(sequence) : 0;
+
+  // The latest checkpoint before the start that the engine takes, whatever
+  // interval it was saved at.
+  resumedFrom = 0;
+  if (checkpoints) {
+    std::vector<juce::int64> positions;
+    for (const auto &file : settings.checkpoints.findChildFiles(
+             juce::File::findFiles, false,
+             juce::String::toHexString((juce::int64)key) + "-*.gs1e")) {
+      const auto pos = file.getFileNameWithoutExtension()
+                           .fromLastOccurrenceOf("-", false, false)
+                           .getLargeIntValue();
+      if (pos > 0 && pos <= firstBlock) {
+        positions.push_back(pos);
+      }
+    }
+    std::sort(positions.rbegin(), positions.rend());
+    for (const auto pos : positions) {
+      juce::MemoryBlock state;
+      if (getCheckpointFile(key, pos).loadFileAsData(state) &&
+          processor.restoreEngineState(state.getData(), state.getSize())) {
+        resumedFrom = pos;
+        break;
+      }
+    }
+  }
+
+  int eventIndex = 0;
+  while (eventIndex < sequence.getNumEvents() &&
+         (juce::int64)(sequence.getEventPointer(eventIndex)
+                           ->message.getTimeStamp() *
+                       settings.sampleRate) < resumedFrom) {
+    eventIndex++;
+  }
+
+  for (juce::int64 pos = resumedFrom; pos < totalSamples; pos += blockSize) {
+    if (checkpoints && pos > resumedFrom && pos % interval == 0 &&
+        processor.saveEngineState(engineState.getData(),
+                                  engineState.getSize())) {
+      settings.checkpoints.createDirectory();
+      getCheckpointFile(key, pos).replaceWithData(engineState.getData(),
+                                                  engineState.getSize());
+    }
+
+    const int numSamples =
+        (int)juce::jmin<juce::int64>(blockSize, totalSamples - pos);
+
+    midi.clear();
+    while (eventIndex < sequence.getNumEvents()) {
+      const auto &message = sequence.getEventPointer(eventIndex)->message;
+      const auto samplePos =
+          (juce::int64)(message.getTimeStamp() * settings.sampleRate);
+      if (samplePos >= pos + numSamples) {
+        break;
+      }
+      if (!message.isMetaEvent()) {
+        midi.addEvent(message,
+                      (int)juce::jmax<juce::int64>(0, samplePos - pos));
+      }
+      eventIndex++;
+    }
+
+    juce::AudioBuffer<float> block(buffer.getArrayOfWritePointers(),
+                                   buffer.getNumChannels(), numSamples);
+    block.clear();
+    processor.processBlock(block, midi);
+    if (pos >= firstBlock) {
+      sink(block);
+    }
+  }
+  return totalSamples - firstBlock;
+}
+
+// FNV-1a over everything that shapes the engine state of a render: the
+// events, the rate, the block size, the patches (by bank file and date), the
+// FM routing, the polyphony and the note cache. The operator lookup and the
+// render threads don't change the output.
+juce::uint64 HeadlessRenderer::getCheckpointKey(
+    const juce::MidiMessageSequence &sequence) const {
+  juce::uint64 hash = 0xcbf29ce484222325ull;
+  auto add = [&hash](const void *data, size_t size) {
+    for (size_t i = 0; i < size; i++) {
+      hash = (hash ^ static_cast<const uint8_t *>(data)[i]) *
+             0x100000001b3ull;
+    }
+  };
+  add(&settings.sampleRate, sizeof(settings.sampleRate));
+  add(&settings.blockSize, sizeof(settings.blockSize));
+  const auto bankPath = settings.bank.getFullPathName();
+  add(bankPath.toRawUTF8(), bankPath.getNumBytesAsUTF8());
+  const auto bankTime =
+      settings.bank.getLastModificationTime().toMilliseconds();
+  add(&bankTime, sizeof(bankTime));
+  add(&settings.patch, sizeof(settings.patch));
+  add(settings.fmModes, sizeof(settings.fmModes));
+  add(&settings.polyphony, sizeof(settings.polyphony));
+  add(&settings.noteCache, sizeof(settings.noteCache));
+  for (int i = 0; i < sequence.getNumEvents(); i++) {
+    const auto &message = sequence.getEventPointer(i)->message;
+    const double time = message.getTimeStamp();
+    add(&time, sizeof(time));
+    add(message.getRawData(), (size_t)message.getRawDataSize());
+  }
+  return hash;
+}
+
+juce::File HeadlessRenderer::getCheckpointFile(juce::uint64 key,
+                                               juce::int64 position) const {
+  return settings.checkpoints.getChildFile(
+      juce::String::toHexString((juce::int64)key) + "-" +
+      juce::String(position) + ".gs1e");
+}
+
+//==============================================================================
+juce::MidiMessageSequence
+HeadlessRenderer::loadMidiFile(const juce::File &file) {
+  juce::MidiMessageSequence result;
+  juce::FileInputStream stream(file);
+  juce::MidiFile midiFile;
+  if (!stream.openedOk() || !midiFile.readFrom(stream)) {
+    return result;
+  }
+  midiFile.convertTimestampTicksToSeconds();
+  for (int track = 0; track < midiFile.getNumTracks(); track++) {
+    result.addSequence(*midiFile.getTrack(track), 0.0);
+  }
+  result.updateMatchedPairs();
+  return result;
+}
+
+juce::MidiMessageSequence
+HeadlessRenderer::makePattern(const juce::String &name, double seconds) {
+  juce::MidiMessageSequence seq;
+  auto add = [&seq](juce::MidiMessage message, double time) {
+    message.setTimeStamp(time);
+    seq.addEvent(message);
+  };
+
+  if (name == "arp") {
+    // Sixteenths at 120 BPM sweeping up and down four octaves.
+    const double step = 0.125;
+    int index = 0;
+    for (double t = 0; t < seconds; t += step, index++) {
+      const int pos = index % 56;
+      const int note = 36 + (pos < 28 ? pos : 56 - pos) * 2;
+      add(juce::MidiMessage::noteOn(1, note, (juce::uint8)(60 + index % 60)),
+          t);
+      add(juce::MidiMessage::noteOff(1, note), t + step * 0.9);
+    }
+    return seq;
+  }
+
+  // "chords" and "dense": four-note chords walking across the keyboard.
+  const bool dense = name == "dense";
+  const int shape[] = {0, 4, 7, 11};
+  const double length = 0.5;
+  int index = 0;
+  for (double t = 0; t < seconds; t += length, index++) {
+    const int root = 33 + (index * 5) % 60;
+    for (int n = 0; n < 4; n++) {
+      add(juce::MidiMessage::noteOn(1, root + shape[n],
+                                    (juce::uint8)(50 + (index * 13 + n) % 77)),
+          t);
+      add(juce::MidiMessage::noteOff(1, root + shape[n]), t + length * 0.8);
+    }
+    if (dense) {
+      add(juce::MidiMessage::controllerEvent(1, 64, 127), t + 0.01);
+      add(juce::MidiMessage::controllerEvent(1, 64, 0), t + length - 0.01);
+    }
+  }
+  if (dense) {
+    // Mod wheel every millisecond, like a recorded controller lane.
+    for (double t = 0; t < seconds; t += 0.001) {
+      const double wave = std::sin(t * juce::MathConstants<double>::twoPi);
+      add(juce::MidiMessage::controllerEvent(1, 1, (int)(64 + 63 * wave)), t);
+    }
+  }
+  return seq;
+}
+
+std::unique_ptr<juce::AudioFormatWriter>
+HeadlessRenderer::createWriter(const juce::File &file, double sampleRate,
+                               int bitsPerSample) {
+  file.deleteFile();
+  auto stream = std::make_unique<juce::FileOutputStream>(file);
+  if (!stream->openedOk()) {
+    return nullptr;
+  }
+  std::unique_ptr<juce::AudioFormatWriter> writer;
+  if (file.hasFileExtension("flac")) {
+    juce::FlacAudioFormat flac;
+    writer.reset(flac.createWriterFor(stream.get(), sampleRate, 2,
+                                      bitsPerSample, {}, 0));
+  } else {
+    juce::WavAudioFormat wav;
+    writer.reset(wav.createWriterFor(stream.get(), sampleRate, 2,
+                                     bitsPerSample, {}, 0));
+  }
+  if (writer != nullptr) {
+    stream.release(); // Now owned by the writer.
+  }
+  return writer;
+}
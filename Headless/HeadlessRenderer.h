@@ -0,0 +1,82 @@
+/*
+  ==============================================================================
+
+    Drives GS1_juceAudioProcessor without a host, from a MIDI sequence to
+    plain audio buffers.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include "../Source/PluginProcessor.h"
+#include <JuceHeader.h>
+
+struct RenderSettings {
+  double sampleRate = 48000.0;
+  int blockSize = 512;
+  juce::File bank; // Factory bank if empty.
+  int patch = 0;
+  int fmModes[2] = {0, 0}; // CH1, CH2
+  int polyphony = GS1_juceAudioProcessor::defaultPolyphony;
+  double tailSeconds = 2.0;
+  int renderThreads = 0; // See GS1_juceAudioProcessor::setRenderThreads().
+  FMLookup lookup = FMLookup::twoStage;
+  bool noteCache = false; // See GS1_juceAudioProcessor::enableNoteCache().
+  NoteCacheSettings cacheSettings;
+  // Directory of engine checkpoints, see HeadlessRenderer::render(). None
+  // are made or used if empty.
+  juce::File checkpoints;
+  double checkpointSeconds = 10.0; // Rounded to whole blocks.
+};
+
+//==============================================================================
+class HeadlessRenderer {
+public:
+  explicit HeadlessRenderer(const RenderSettings &settings);
+
+  // Renders every event of the sequence (timestamps in seconds) followed by
+  // the configured tail, handing each processed block to the sink. Returns
+  // the number of samples handed over.
+  //
+  // Only blocks from the one holding startSample on reach the sink, the
+  // same as in a full render, bit for bit. With a checkpoint directory the
+  // engine state is saved there every checkpointSeconds, under a key of the
+  // sequence and settings, and a render resumes from the latest checkpoint
+  // before startSample instead of from zero.
+  juce::int64 render(
+      const juce::MidiMessageSequence &sequence,
+      const std::function<void(const juce::AudioBuffer<float> &)> &sink,
+      juce::int64 startSample = 0);
+
+  // Where the last render() started the engine, 0 unless it resumed from a
+  // checkpoint.
+  juce::int64 getResumedFrom() const { return resumedFrom; }
+
+  GS1_juceAudioProcessor &getProcessor() { return processor; }
+
+  //==============================================================================
+  // Merges all tracks of a Standard MIDI File, timestamps in seconds.
+  static juce::MidiMessageSequence loadMidiFile(const juce::File &file);
+
+  // Synthetic test material: "chords", "arp" or "dense" (chords plus sustain
+  // pedal and controller traffic).
+  static juce::MidiMessageSequence makePattern(const juce::String &name,
+                                               double seconds);
+
+  // Stereo FLAC for .flac files (16 or 24 bits), WAV otherwise.
+  static std::unique_ptr<juce::AudioFormatWriter>
+  createWriter(const juce::File &file, double sampleRate, int bitsPerSample);
+
+private:
+  juce::uint64
+  getCheckpointKey(const juce::MidiMessageSequence &sequence) const;
+  juce::File getCheckpointFile(juce::uint64 key, juce::int64 position) const;
+
+  RenderSettings settings;
+  GS1_juceAudioProcessor processor;
+  juce::AudioBuffer<float> buffer;
+  juce::MidiBuffer midi;
+  juce::MemoryBlock engineState;
+  juce::int64 resumedFrom = 0;
+};
@@ -0,0 +1,315 @@
+/*
+  ==============================================================================
+
+    gs1-headless: renders and benchmarks the GS1 engine without a host.
+
+  ==============================================================================
+*/
+
+#include "BatchRenderer.h"
+#include "Benchmark.h"
+#include "HeadlessRenderer.h"
+#include "ProfileLog.h"
+#include "Verify.h"
+#include <JuceHeader.h>
+
+static double doubleOption(const juce::ArgumentList &args,
+                           const juce::String &option, double fallback) {
+  auto value = args.getValueForOption(option);
+  return value.isNotEmpty() ? value.getDoubleValue() : fallback;
+}
+
+static int intOption(const juce::ArgumentList &args,
+                     const juce::String &option, int fallback) {
+  auto value = args.getValueForOption(option);
+  return value.isNotEmpty() ? value.getIntValue() : fallback;
+}
+
+// Options shared by render and batch.
+static RenderSettings readRenderSettings(const juce::ArgumentList &args) {
+  RenderSettings settings;
+  settings.sampleRate = doubleOption(args, "--rate", settings.sampleRate);
+  settings.blockSize = intOption(args, "--block", settings.blockSize);
+  if (args.containsOption("--bank")) {
+    settings.bank = args.getExistingFileForOption("--bank");
+    if (PatchBank::open(settings.bank) == nullptr) {
+      juce::ConsoleApplication::fail("Not a GS1 bank: " +
+                                     settings.bank.getFullPathName());
+    }
+  }
+  settings.tailSeconds = doubleOption(args, "--tail", settings.tailSeconds);
+  settings.polyphony = juce::jlimit(
+      GS1_juceAudioProcessor::minPolyphony,
+      GS1_juceAudioProcessor::maxPolyphony,
+      intOption(args, "--voices", settings.polyphony));
+  if (args.containsOption("--lookup") &&
+      !parseKernelLookup(args.getValueForOption("--lookup"),
+                         settings.lookup)) {
+    juce::ConsoleApplication::fail("Unknown --lookup " +
+                                   args.getValueForOption("--lookup"));
+  }
+
+  // --fm=<ch1><ch2>, each 0=NORM 1=PI/2 2=PI 3=CROSS.
+  auto fm = args.getValueForOption("--fm");
+  if (fm.length() == 2) {
+    settings.fmModes[0] = juce::jlimit(0, 3, fm.substring(0, 1).getIntValue());
+    settings.fmModes[1] = juce::jlimit(0, 3, fm.substring(1, 2).getIntValue());
+  }
+  return settings;
+}
+
+static void renderCommand(const juce::ArgumentList &args) {
+  auto settings = readRenderSettings(args);
+  settings.patch = intOption(args, "--patch", settings.patch);
+  settings.renderThreads =
+      juce::jmax(0, intOption(args, "--threads", settings.renderThreads));
+
+  // --note-cache[=<seconds held>]
+  if (args.containsOption("--note-cache")) {
+    settings.noteCache = true;
+    auto &cache = settings.cacheSettings;
+    cache.seconds = doubleOption(args, "--note-cache", cache.seconds);
+    cache.velocityLayers = juce::jlimit(
+        1, 127, intOption(args, "--cache-layers", cache.velocityLayers));
+  }
+
+  // --checkpoints=<dir>: engine checkpoints a later --from resumes at.
+  if (args.containsOption("--checkpoints")) {
+    settings.checkpoints = args.getFileForOption("--checkpoints");
+    settings.checkpointSeconds = doubleOption(args, "--checkpoint-every",
+                                              settings.checkpointSeconds);
+  }
+  const auto startSample =
+      (juce::int64)(doubleOption(args, "--from", 0.0) * settings.sampleRate);
+
+  auto outFile = args.getFileForOption("--out");
+
+  juce::MidiMessageSequence sequence;
+  if (args.containsOption("--midi")) {
+    auto midiFile = args.getExistingFileForOption("--midi");
+    sequence = HeadlessRenderer::loadMidiFile(midiFile);
+    if (sequence.getNumEvents() == 0) {
+      juce::ConsoleApplication::fail("Could not read MIDI file " +
+                                     midiFile.getFullPathName());
+    }
+  } else {
+    auto pattern = args.getValueForOption("--pattern");
+    sequence = HeadlessRenderer::makePattern(
+        pattern.isNotEmpty() ? pattern : "chords",
+        doubleOption(args, "--seconds", 10.0));
+  }
+
+  auto writer = HeadlessRenderer::createWriter(
+      outFile, settings.sampleRate, intOption(args, "--bits", 24));
+  if (writer == nullptr) {
+    juce::ConsoleApplication::fail("Could not write " +
+                                   outFile.getFullPathName());
+  }
+
+  // --profile=<file.csv|file.json>: the cost of every block.
+  std::unique_ptr<ProfileLog> profile;
+  if (args.containsOption("--profile")) {
+    auto profileFile = args.getFileForOption("--profile");
+    profile = std::make_unique<ProfileLog>(profileFile);
+    if (!profile->openedOk()) {
+      juce::ConsoleApplication::fail("Could not write " +
+                                     profileFile.getFullPathName());
+    }
+  }
+
+  HeadlessRenderer renderer(settings);
+  if (const auto *cache = renderer.getProcessor().getNoteCache()) {
+    std::printf("note cache: %d notes, %.1f MB\n", cache->getNumNotes(),
+                cache->getMemoryBytes() / 1048576.0);
+  }
+  auto &profiler = renderer.getProcessor().profiler;
+  const auto start = juce::Time::getHighResolutionTicks();
+  const auto numSamples = renderer.render(
+      sequence,
+      [&](const juce::AudioBuffer<float> &block) {
+        writer->writeFromAudioSampleBuffer(block, 0, block.getNumSamples());
+        if (profile != nullptr) {
+          profile->drain(profiler);
+        }
+      },
+      startSample);
+  const double elapsed = juce::Time::highResolutionTicksToSeconds(
+      juce::Time::getHighResolutionTicks() - start);
+
+  if (renderer.getResumedFrom() > 0) {
+    std::printf("resumed from the checkpoint at %.2f s\n",
+                renderer.getResumedFrom() / settings.sampleRate);
+  }
+  const double seconds = (double)numSamples / settings.sampleRate;
+  std::printf(
+      "%s: %.2f s of audio in %.3f s (%.2fx realtime, %.2f ns/sample)\n",
+      outFile.getFullPathName().toRawUTF8(), seconds, elapsed,
+      seconds / elapsed, elapsed * 1e9 / (double)numSamples);
+  if (profile != nullptr) {
+    profile->printSummary(profiler);
+  }
+}
+
+static void batchCommand(const juce::ArgumentList &args) {
+  BatchSettings settings;
+  settings.render = readRenderSettings(args);
+  settings.bitsPerSample = intOption(args, "--bits", settings.bitsPerSample);
+  settings.numThreads = juce::jmax(0, intOption(args, "--jobs", 0));
+
+  std::vector<BatchJob> jobs;
+  juce::String error;
+  if (!BatchRenderer::readManifest(args.getExistingFileForOption("--manifest"),
+                                   jobs, error)) {
+    juce::ConsoleApplication::fail(error);
+  }
+
+  BatchRenderer batch(settings);
+  const auto results = batch.run(jobs);
+  const auto numFailed =
+      std::count_if(results.begin(), results.end(),
+                    [](const BatchResult &r) { return r.error.isNotEmpty(); });
+  if (numFailed > 0) {
+    juce::ConsoleApplication::fail(juce::String((int)numFailed) + " of " +
+                                   juce::String((int)results.size()) +
+                                   " jobs failed");
+  }
+}
+
+static void benchCommand(const juce::ArgumentList &args) {
+  BenchmarkSettings settings;
+  settings.sampleRate = doubleOption(args, "--rate", settings.sampleRate);
+  settings.blockSize = intOption(args, "--block", settings.blockSize);
+  settings.seconds = doubleOption(args, "--seconds", settings.seconds);
+  settings.csv = args.containsOption("--csv");
+  settings.only = args.getValueForOption("--only");
+  settings.isa = args.getValueForOption("--isa");
+  settings.lookup = args.getValueForOption("--lookup");
+  settings.renderThreads =
+      juce::jmax(0, intOption(args, "--threads", settings.renderThreads));
+
+  FMKernelIsa isa;
+  if (settings.isa.isNotEmpty() && !parseKernelIsa(settings.isa, isa)) {
+    juce::ConsoleApplication::fail("Unknown or unsupported --isa " +
+                                   settings.isa);
+  }
+  FMLookup lookup;
+  if (settings.lookup.isNotEmpty() &&
+      !parseKernelLookup(settings.lookup, lookup)) {
+    juce::ConsoleApplication::fail("Unknown --lookup " + settings.lookup);
+  }
+
+  Benchmark(settings).run();
+}
+
+static void goldenCommand(const juce::ArgumentList &args) {
+  VerifySettings settings;
+  if (args.containsOption("--ref")) {
+    settings.referenceDir = args.getFileForOption("--ref");
+  }
+  settings.tolerance =
+      (float)doubleOption(args, "--tolerance", settings.tolerance);
+  settings.update = args.containsOption("--update");
+  if (!Verify(settings).runGolden()) {
+    juce::ConsoleApplication::fail("Golden check failed", 1);
+  }
+}
+
+static void fuzzCommand(const juce::ArgumentList &args) {
+  VerifySettings settings;
+  settings.iterations = intOption(args, "--iterations", settings.iterations);
+  settings.seed = intOption(args, "--seed", (int)settings.seed);
+  if (!Verify(settings).runFuzz()) {
+    juce::ConsoleApplication::fail("Fuzzing found differences", 1);
+  }
+}
+
+// Writes the factory patches as a bank file, a starting point for libraries.
+static void bankCommand(const juce::ArgumentList &args) {
+  auto outFile = args.getFileForOption("--out");
+  const auto factory = PatchBank::getFactory();
+  if (!PatchBank::write(outFile, *factory)) {
+    juce::ConsoleApplication::fail("Could not write " +
+                                   outFile.getFullPathName());
+  }
+  std::printf("%s: %d patches\n", outFile.getFullPathName().toRawUTF8(),
+              factory->getNumPatches());
+}
+
+//==============================================================================
+int main(int argc, char *argv[]) {
+  juce::ScopedJuceInitialiser_GUI libraryInitialiser;
+
+  juce::ConsoleApplication app;
+  app.addHelpCommand("--help|-h", "Usage:", true);
+
+  app.addCommand(
+      {"render",
+       "render --out=<file.wav|file.flac> "
+       "[--midi=<file.mid> | --pattern=chords|arp|dense]",
+       "Renders a MIDI file or a synthetic pattern to WAV or FLAC.",
+       "Options: --rate=<Hz> --block=<samples> --bank=<file.gs1b> "
+       "--patch=<index> --fm=<ch1><ch2> --seconds=<pattern length> "
+       "--tail=<seconds> --bits=<16|24|32> --threads=<extra render threads> "
+       "--voices=<polyphony, 8-1024> --lookup=<operator lookup> "
+       "--profile=<file.csv|file.json> "
+       "--note-cache[=<seconds held>] --cache-layers=<velocity layers> "
+       "--checkpoints=<dir> --checkpoint-every=<seconds> "
+       "--from=<seconds, output starts at its block>",
+       renderCommand});
+
+  app.addCommand(
+      {"batch", "batch --manifest=<file> [--jobs=<engines at once>]",
+       "Renders a list of MIDI files on every core.",
+       "The manifest has one job per line, <MIDI file>,<patch index>,"
+       "<output file.wav|file.flac>, paths relative to the manifest. Each "
+       "job runs its own single threaded engine and streams to its file. "
+       "Prints the throughput of each job as it finishes and the total. "
+       "Options: --rate=<Hz> --block=<samples> --bank=<file.gs1b> "
+       "--fm=<ch1><ch2> --tail=<seconds> --bits=<16|24|32> "
+       "--voices=<polyphony, 8-1024> --lookup=<operator lookup>",
+       batchCommand});
+
+  app.addCommand(
+      {"bench",
+       "bench [--only=voices|fm|patches|kernels|lookups|pitch|cache|"
+       "threads|polyphony|micro] [--csv]",
+       "Measures realtime factor, ns/sample and ns/voice-sample.",
+       "Sweeps 1-32 voices, all 16 FM routing pairs, every patch, every "
+       "FM kernel the CPU supports with every operator lookup, still, "
+       "vibrato and bent voices, live and cached voices, 0-3 render "
+       "threads, then polyphony from 8 to 1024 with every voice "
+       "sounding. --only=micro times each DSP building block on its own "
+       "instead. Options: --rate=<Hz> --block=<samples> "
+       "--seconds=<per row> --isa=scalar|sse41|avx2|avx512 "
+       "--lookup=two-stage|fused-exp|fused-quarter|fused-full|shuffle "
+       "--threads=<extra render threads>",
+       benchCommand});
+
+  app.addCommand(
+      {"golden", "golden [--ref=<dir>] [--update] [--tolerance=<abs>]",
+       "Checks that the DSP output is unchanged.",
+       "Compares hashes of the operator tables, envelopes and per-voice "
+       "engine (every patch and FM routing) bit for bit with the recorded "
+       "ones. With --ref also compares chorus, resampler and full renders "
+       "with reference files within tolerance. --update prints new hashes "
+       "and writes the reference files.",
+       goldenCommand});
+
+  app.addCommand(
+      {"fuzz", "fuzz [--iterations=<n>] [--seed=<n>]",
+       "Differential fuzzing of the optimised DSP paths.",
+       "Random operator states through every SIMD kernel and operator "
+       "lookup against the scalar kernel and the per-voice code, and "
+       "chunked envelope, chorus and "
+       "resampler renders against one-shot ones. All must match exactly. "
+       "Then random MIDI, switching MPE with notes held, against the voice "
+       "count of every part. Bank files with a broken record and note "
+       "caches with a broken checkpoint must not load.",
+       fuzzCommand});
+
+  app.addCommand({"bank", "bank --out=<file.gs1b>",
+                  "Exports the factory patches as a bank file.",
+                  "The file can be passed to render --bank.", bankCommand});
+
+  return app.findAndRunCommand(argc, argv);
+}
@@ -0,0 +1,61 @@
+/*
+  ==============================================================================
+
+    Writes the engine profile of a headless render to CSV or JSON.
+
+  ==============================================================================
+*/
+
+#include "ProfileLog.h"
+
+ProfileLog::ProfileLog(const juce::File &file)
+    : json(file.hasFileExtension("json")) {
+  file.deleteFile();
+  stream = std::make_unique<juce::FileOutputStream>(file);
+  if (openedOk()) {
+    *stream << (json ? juce::String("[") : EngineProfiler::getCsvHeader())
+            << "\n";
+  }
+}
+
+ProfileLog::~ProfileLog() {
+  if (openedOk() && json) {
+    *stream << "\n]\n";
+  }
+}
+
+void ProfileLog::drain(EngineProfiler &profiler) {
+  const int capacity = (int)std::size(blocks);
+  for (int count; (count = profiler.read(blocks, capacity)) > 0;) {
+    for (int i = 0; i < count; i++) {
+      const auto &block = blocks[i];
+      if (json) {
+        *stream << (numBlocks > 0 ? ",\n  " : "  ")
+                << EngineProfiler::toJson(block);
+      } else {
+        *stream << EngineProfiler::toCsv(block) << "\n";
+      }
+      for (int s = 0; s < EngineProfiler::numStages; s++) {
+        stageTotals[s] += block.stageNs[s];
+      }
+      if (block.deadlineRatio > worst.deadlineRatio) {
+        worst = block;
+      }
+      numBlocks++;
+    }
+  }
+}
+
+void ProfileLog::printSummary(const EngineProfiler &profiler) const {
+  std::printf("profile: %lld blocks, %llu dropped, mean ns per block:",
+              (long long)numBlocks,
+              (unsigned long long)profiler.getNumDropped());
+  for (int s = 0; s < EngineProfiler::numStages; s++) {
+    std::printf(" %s %.0f", EngineProfiler::getStageName(s),
+                numBlocks > 0 ? stageTotals[s] / (double)numBlocks : 0.0);
+  }
+  std::printf("\nworst block at sample %lld: %.1f%% of its deadline, "
+              "%d voices\n",
+              (long long)worst.samplePosition, worst.deadlineRatio * 100.0,
+              worst.activeVoices);
+}
@@ -0,0 +1,37 @@
+/*
+  ==============================================================================
+
+    Writes the engine profile of a headless render to CSV or JSON.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include "../Source/EngineProfiler.h"
+#include <JuceHeader.h>
+
+//==============================================================================
+class ProfileLog {
+public:
+  // JSON if the file ends in .json, CSV otherwise.
+  explicit ProfileLog(const juce::File &file);
+  ~ProfileLog();
+
+  bool openedOk() const { return stream != nullptr && stream->openedOk(); }
+
+  // Moves every block the profiler has into the file.
+  void drain(EngineProfiler &profiler);
+
+  // Mean stage costs, the worst block and the dropped count.
+  void printSummary(const EngineProfiler &profiler) const;
+
+private:
+  std::unique_ptr<juce::FileOutputStream> stream;
+  bool json = false;
+
+  BlockProfile blocks[256];
+  juce::int64 numBlocks = 0;
+  double stageTotals[EngineProfiler::numStages] = {};
+  BlockProfile worst;
+};
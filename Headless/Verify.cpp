@@ -0,0 +1,684 @@
+/*
+  ==============================================================================
+
+    Golden renders and differential fuzzing of the DSP code.
+
+  ==============================================================================
+*/
+
+#include "Verify.h"
+#include "../Source/Tables.h"
+#include "Benchmark.h"
+#include "HeadlessRenderer.h"
+
+static constexpr double engineRate = 34687; // SampleRate of the engine.
+
+// FNV-1a over 32-bit values.
+struct Hash {
+  uint64_t value = 0xcbf29ce484222325ull;
+
+  void add(int32_t x) {
+    for (int b = 0; b < 4; b++) {
+      value = (value ^ ((uint32_t)x >> (8 * b) & 0xFF)) * 0x100000001b3ull;
+    }
+  }
+};
+
+// Recorded with `gs1-headless golden --update`. A change here is a change of
+// the GS1 sound and needs a reason in the commit.
+//
+// They pin the engine as it was when they were recorded, not the original
+// float engine, which had already been changed on purpose in three ways:
+// - PI/2 and PI on channel 2 gate the modulator by AMP[3] and feed M2 into
+//   CH2 (they used AMP[1] and M1), which changes every fm?1 and fm?2 pair;
+// - the envelopes are fixed point, with a clamped attack peak and no
+//   two-sample gate delay, within 0.05 dB of the float ones, which changes
+//   every hash of the engine by a little;
+// - the key scaling index is clamped, so keys below MIDI 25 and above 112
+//   no longer read past the scaling tables.
+struct GoldenHash {
+  const char *name;
+  uint64_t hash;
+};
+
+static const GoldenHash goldenHashes[] = {
+    {"lookupSin", 0xca7b63a1422f0eadull},
+    {"lookupExp", 0x6abf806d4eccaef5ull},
+    {"envelopes", 0x9306c0ec621d97d1ull},
+    {"engine EP11 fm00", 0xf51bcc5a03cc268bull},
+    {"engine EP11 fm01", 0xd8e657b6a1485968ull},
+    {"engine EP11 fm02", 0xe927c1fcfbb83dbdull},
+    {"engine EP11 fm03", 0x2a2d943657e87ce6ull},
+    {"engine EP11 fm10", 0xfb598c9979db4d65ull},
+    {"engine EP11 fm11", 0x18e747a64e3bcb5dull},
+    {"engine EP11 fm12", 0x8ff1f85a142c23a8ull},
+    {"engine EP11 fm13", 0xbc9e3237b45d40c5ull},
+    {"engine EP11 fm20", 0xabc5402937b21adaull},
+    {"engine EP11 fm21", 0x7897132d3724784bull},
+    {"engine EP11 fm22", 0xa6cbd6bf8cf75273ull},
+    {"engine EP11 fm23", 0x0c19079c9a57a38full},
+    {"engine EP11 fm30", 0xd0c1d30b5a821353ull},
+    {"engine EP11 fm31", 0xd9e510e3af0ff6adull},
+    {"engine EP11 fm32", 0x8b311ca68aecead5ull},
+    {"engine EP11 fm33", 0x301e69cd8d0152cfull},
+    {"engine EP22 fm00", 0x6cdc55a222eae387ull},
+    {"engine EP22 fm01", 0xf28f5423ae926d38ull},
+    {"engine EP22 fm02", 0x0038ca5347c7c608ull},
+    {"engine EP22 fm03", 0x6f5bab84b8f38849ull},
+    {"engine EP22 fm10", 0x3fc94174c6cc8abeull},
+    {"engine EP22 fm11", 0xe406f4275867270aull},
+    {"engine EP22 fm12", 0xcc3d45ebc2ca5bf0ull},
+    {"engine EP22 fm13", 0x69153bc63bc28ec4ull},
+    {"engine EP22 fm20", 0x47c467d415b2f96full},
+    {"engine EP22 fm21", 0xd9359ef4fb82d598ull},
+    {"engine EP22 fm22", 0x4e2ec50a1610a1b6ull},
+    {"engine EP22 fm23", 0xc67ad8399b0f3664ull},
+    {"engine EP22 fm30", 0x0e2805d3720b963aull},
+    {"engine EP22 fm31", 0x2e6c8845b86e8e9aull},
+    {"engine EP22 fm32", 0xd5a36bc8a73534e6ull},
+    {"engine EP22 fm33", 0x580312b1e0712d91ull},
+};
+
+Verify::Verify(const VerifySettings &s)
+    : settings(s), random(settings.seed) {}
+
+bool Verify::fail(const juce::String &check, const juce::String &detail) {
+  std::printf("FAIL %s: %s\n", check.toRawUTF8(), detail.toRawUTF8());
+  numFailures++;
+  return false;
+}
+
+//==============================================================================
+static uint64_t hashTables(bool exp) {
+  Hash hash;
+  if (exp) {
+    for (int val = 0; val < 0x10000; val++) {
+      hash.add(lookupExp(val));
+    }
+  } else {
+    for (int val = 0; val < 1024; val++) {
+      hash.add(lookupSin(val));
+    }
+  }
+  return hash.value;
+}
+
+// Fast and slow rates, zero and full sustain, short and cut-off stages.
+static uint64_t hashEnvelopes() {
+  const float rates[][4] = {{2000, 2000, 4400, 4400},
+                            {1, 2, 100, 16384},
+                            {0.5f, 15, 3, 1024},
+                            {8000, 0.25f, 60, 7}};
+  Hash hash;
+  for (const auto &attack : rates) {
+    for (const auto &decay : rates) {
+      const int sustain[4] = {0, 128 << 12, 255 << 12, 64 << 12};
+      const int baseAmp[4] = {4095, 4095 + 800, 4095 + 1016, 4095 + 2000};
+      OperatorEnvelopes envelopes;
+      envelopes.start(attack, decay, rates[2], sustain, baseAmp);
+      int32_t amp[4];
+      for (int s = 0; s < 6000; s++) {
+        envelopes.render(s < 1500, 1, amp, 1, 1);
+        for (int n = 0; n < 4; n++) {
+          hash.add(amp[n]);
+        }
+      }
+    }
+  }
+  return hash.value;
+}
+
+// The per-voice engine: every key and velocity of the reference set held for
+// 3000 samples, then released.
+static uint64_t hashEngine(int patch, int ch1Mode, int ch2Mode) {
+  auto processor = std::make_unique<GS1_juceAudioProcessor>();
+  processor->setCurrentProgram(patch);
+  processor->setFMModes(ch1Mode, ch2Mode);
+  processor->prepareToPlay(engineRate, 64);
+  juce::AudioBuffer<float> buffer(2, 64);
+  juce::MidiBuffer midi;
+  processor->processBlock(buffer, midi); // Picks up the patch snapshot.
+
+  Hash hash;
+  for (int key : {25, 40, 60, 72, 90, 108}) {
+    for (int velocity : {1, 64, 127}) {
+      VoiceState voiceState;
+      processor->noteOn(voiceState, patch, key - 24, 127 - velocity);
+      for (int s = 0; s < 15000; s++) {
+        voiceState.GATE = s < 3000;
+        hash.add(processor->fmGenSample(voiceState));
+      }
+    }
+  }
+  return hash.value;
+}
+
+//==============================================================================
+// Deterministic test signal: two partials and some noise.
+static std::vector<float> makeInput(int numSamples) {
+  juce::Random noise(42);
+  std::vector<float> input(numSamples);
+  for (int i = 0; i < numSamples; i++) {
+    input[i] = 0.5f * std::sin(i * 0.031f) + 0.25f * std::sin(i * 0.2f) +
+               0.1f * (noise.nextFloat() - 0.5f);
+  }
+  return input;
+}
+
+static std::vector<float> renderChorus() {
+  const auto input = makeInput(20000);
+  std::vector<float> left(input.size()), right(input.size()), out;
+  Chorus chorus;
+  chorus.prepare(engineRate);
+  chorus.process(input.data(), left.data(), right.data(), (int)input.size());
+  out.insert(out.end(), left.begin(), left.end());
+  out.insert(out.end(), right.begin(), right.end());
+  return out;
+}
+
+// Feeds input through the resampler in output blocks of nextBlock() samples,
+// at most maxBlock.
+template <class NextBlock>
+static std::vector<float> resample(const std::vector<float> &input,
+                                   double outputRate, int maxBlock,
+                                   int numOutput, NextBlock nextBlock) {
+  Resampler resampler;
+  resampler.prepare(engineRate, outputRate, maxBlock, 1);
+  std::vector<float> out(numOutput);
+  size_t read = 0;
+  for (int pos = 0; pos < numOutput;) {
+    const int n = juce::jmin(nextBlock(), numOutput - pos);
+    const int needed = resampler.getInputSamplesNeeded(n);
+    for (int i = 0; i < needed; i++, read++) {
+      resampler.getInputPointer(0)[i] = input[read % input.size()];
+    }
+    float *outputs[] = {out.data() + pos};
+    resampler.process(outputs, n);
+    pos += n;
+  }
+  return out;
+}
+
+static std::vector<float> renderPatch(int patch) {
+  RenderSettings renderSettings;
+  renderSettings.patch = patch;
+  renderSettings.tailSeconds = 0.5;
+  HeadlessRenderer renderer(renderSettings);
+  std::vector<float> out;
+  renderer.render(HeadlessRenderer::makePattern("dense", 3.0),
+                  [&](const juce::AudioBuffer<float> &block) {
+                    for (int c = 0; c < 2; c++) {
+                      out.insert(out.end(), block.getReadPointer(c),
+                                 block.getReadPointer(c) +
+                                     block.getNumSamples());
+                    }
+                  });
+  return out;
+}
+
+bool Verify::checkRender(const juce::String &name,
+                         const std::vector<float> &render) {
+  const auto file = settings.referenceDir.getChildFile(name + ".f32");
+  if (settings.update) {
+    file.replaceWithData(render.data(), render.size() * sizeof(float));
+    std::printf("wrote %s\n", file.getFullPathName().toRawUTF8());
+    return true;
+  }
+
+  juce::MemoryBlock reference;
+  if (!file.loadFileAsData(reference)) {
+    return fail(name, "no reference " + file.getFullPathName());
+  }
+  if (reference.getSize() != render.size() * sizeof(float)) {
+    return fail(name, "length differs from the reference");
+  }
+  const auto *expected = static_cast<const float *>(reference.getData());
+  float maxError = 0;
+  size_t worst = 0;
+  for (size_t i = 0; i < render.size(); i++) {
+    const float error = std::abs(render[i] - expected[i]);
+    if (error > maxError) {
+      maxError = error;
+      worst = i;
+    }
+  }
+  if (maxError > settings.tolerance) {
+    return fail(name, "off by " + juce::String(maxError, 8) + " at sample " +
+                          juce::String((juce::int64)worst));
+  }
+  std::printf("ok   %s (max error %g)\n", name.toRawUTF8(), maxError);
+  return true;
+}
+
+bool Verify::runGolden() {
+  std::vector<std::pair<juce::String, uint64_t>> hashes;
+  auto add = [&](const juce::String &name, uint64_t hash) {
+    hashes.push_back({name, hash});
+  };
+
+  add("lookupSin", hashTables(false));
+  add("lookupExp", hashTables(true));
+  add("envelopes", hashEnvelopes());
+  const auto bank = PatchBank::getFactory();
+  for (int p = 0; p < bank->getNumPatches(); p++) {
+    for (int m1 = 0; m1 < numFMModes; m1++) {
+      for (int m2 = 0; m2 < numFMModes; m2++) {
+        add("engine " + bank->getName(p) + " fm" + juce::String(m1) +
+                juce::String(m2),
+            hashEngine(p, m1, m2));
+      }
+    }
+  }
+
+  for (const auto &[name, hash] : hashes) {
+    if (settings.update) {
+      std::printf("    {\"%s\", 0x%016llxull},\n", name.toRawUTF8(),
+                  (unsigned long long)hash);
+      continue;
+    }
+    const GoldenHash *golden = nullptr;
+    for (const auto &g : goldenHashes) {
+      if (name == g.name) {
+        golden = &g;
+      }
+    }
+    if (golden == nullptr) {
+      fail(name, "no golden hash");
+    } else if (golden->hash != hash) {
+      fail(name, "output changed");
+    } else {
+      std::printf("ok   %s\n", name.toRawUTF8());
+    }
+  }
+
+  if (settings.referenceDir != juce::File()) {
+    settings.referenceDir.createDirectory();
+    checkRender("chorus", renderChorus());
+    checkRender("resampler", resample(makeInput(20000), 48000, 480, 30000,
+                                      [] { return 480; }));
+    for (int p = 0; p < bank->getNumPatches(); p++) {
+      checkRender("render_" + bank->getName(p), renderPatch(p));
+    }
+  }
+
+  std::printf("%d failures\n", numFailures);
+  return numFailures == 0;
+}
+
+//==============================================================================
+static void randomiseLanes(juce::Random &random, FMLanes &lanes,
+                           FMAmpBlock &amps, int numLanes) {
+  lanes.numLanes = numLanes;
+  for (int v = 0; v < FMLanes::maxLanes; v++) {
+    for (int n = 0; n < 4; n++) {
+      lanes.PAI[n][v] = random.nextInt(0x10000000);
+      lanes.CW[n][v] = random.nextInt(1 << 24);
+    }
+    // Modulator outputs are 14bit.
+    lanes.M1[v] = random.nextInt(16384) - 8192;
+    lanes.M2[v] = random.nextInt(16384) - 8192;
+    lanes.M1old1[v] = random.nextInt(16384) - 8192;
+    lanes.M1old2[v] = random.nextInt(16384) - 8192;
+    lanes.M2old1[v] = random.nextInt(16384) - 8192;
+    lanes.M2old2[v] = random.nextInt(16384) - 8192;
+  }
+  // Muted, full level and everything in between.
+  for (int s = 0; s < FMAmpBlock::maxSamples; s++) {
+    for (int n = 0; n < 4; n++) {
+      for (int v = 0; v < FMLanes::maxLanes; v++) {
+        const int pick = random.nextInt(8);
+        amps.amp[s][n][v] = pick == 0   ? 4095
+                            : pick == 1 ? 0
+                                        : random.nextInt(4096);
+      }
+    }
+  }
+}
+
+static bool sameLanes(const FMLanes &a, const FMLanes &b) {
+  return std::memcmp(&a, &b, sizeof(FMLanes)) == 0;
+}
+
+bool Verify::runFuzz() {
+  const FMKernel scalar = getFMKernel(FMKernelIsa::scalar);
+  static const char *isaNames[] = {"scalar", "sse41", "avx2", "avx512"};
+  static const char *lookupNames[] = {"two-stage", "fused-exp",
+                                      "fused-quarter", "fused-full",
+                                      "shuffle"};
+
+  int numKernelCases = 0;
+  for (int i = 0; i < settings.iterations; i++) {
+    const int m1 = random.nextInt(numFMModes);
+    const int m2 = random.nextInt(numFMModes);
+    const int numSamples = 1 + random.nextInt(FMAmpBlock::maxSamples);
+    const int numLanes = random.nextBool() ? 16 : 32;
+    const juce::String mode = "fm" + juce::String(m1) + juce::String(m2);
+
+    auto reference = std::make_unique<FMLanes>();
+    auto amps = std::make_unique<FMAmpBlock>();
+    randomiseLanes(random, *reference, *amps, numLanes);
+    const auto start = std::make_unique<FMLanes>(*reference);
+    int32_t expected[FMAmpBlock::maxSamples];
+    scalar.render[m1][m2](*reference, *amps, numSamples, expected);
+
+    // The scalar block kernel against the per-voice code.
+    auto voices = std::make_unique<FMLanes>(*start);
+    const FMSampleFn sample = getFMSampleFn(m1, m2);
+    for (int s = 0; s < numSamples; s++) {
+      int32_t sum = 0;
+      for (int v = 0; v < numLanes; v++) {
+        int32_t PAE[4], amp[4];
+        for (int n = 0; n < 4; n++) {
+          voices->PAI[n][v] &= 0xFFFFFFF;
+          PAE[n] = voices->PAI[n][v] >> 18;
+          voices->PAI[n][v] += voices->CW[n][v];
+          amp[n] = amps->amp[s][n][v];
+        }
+        sum += sample(PAE, amp, voices->M1[v], voices->M2[v],
+                      voices->M1old1[v], voices->M1old2[v], voices->M2old1[v],
+                      voices->M2old2[v]);
+      }
+      if (sum != expected[s]) {
+        fail("per-voice " + mode, "sample " + juce::String(s) + " differs");
+        break;
+      }
+    }
+    if (!sameLanes(*voices, *reference)) {
+      fail("per-voice " + mode, "voice state differs");
+    }
+
+    // Every other kernel and operator lookup against the scalar two-stage
+    // one.
+    for (auto *isaName : isaNames) {
+      FMKernelIsa isa;
+      if (!parseKernelIsa(isaName, isa)) {
+        continue;
+      }
+      for (auto *lookupName : lookupNames) {
+        FMLookup lookup;
+        parseKernelLookup(lookupName, lookup);
+        const FMKernel kernel = getFMKernel(isa, lookup);
+        if (kernel.lookup != lookup ||
+            (isa == FMKernelIsa::scalar && lookup == FMLookup::twoStage)) {
+          continue;
+        }
+        auto lanes = std::make_unique<FMLanes>(*start);
+        int32_t out[FMAmpBlock::maxSamples];
+        kernel.render[m1][m2](*lanes, *amps, numSamples, out);
+        if (std::memcmp(out, expected, numSamples * sizeof(int32_t)) != 0 ||
+            !sameLanes(*lanes, *reference)) {
+          fail(juce::String(isaName) + " " + lookupName + " " + mode,
+               "differs from scalar, case " + juce::String(i));
+        }
+        numKernelCases++;
+      }
+    }
+  }
+  std::printf("kernels: %d cases against scalar, %d against per-voice\n",
+              numKernelCases, settings.iterations);
+
+  // Envelopes rendered in random chunks against one call per gate state.
+  for (int i = 0; i < settings.iterations; i++) {
+    float rates[3][4];
+    int sustain[4], baseAmp[4];
+    for (int n = 0; n < 4; n++) {
+      for (auto &stageRates : rates) {
+        stageRates[n] = std::exp(random.nextFloat() * 20.0f - 6.0f);
+      }
+      sustain[n] = random.nextInt(256) << 12;
+      baseAmp[n] = 4095 + random.nextInt(3000);
+    }
+    OperatorEnvelopes whole, chunked;
+    whole.start(rates[0], rates[1], rates[2], sustain, baseAmp);
+    chunked = whole;
+
+    const int held = 1 + random.nextInt(4000);
+    const int released = 1 + random.nextInt(4000);
+    std::vector<int32_t> expected(4 * (held + released));
+    std::vector<int32_t> actual(expected.size());
+    whole.render(true, held, expected.data(), 1, 4);
+    whole.render(false, released, expected.data() + 4 * held, 1, 4);
+    for (int pos = 0; pos < held + released;) {
+      const int end = pos < held ? held : held + released;
+      const int n = juce::jmin(1 + random.nextInt(100), end - pos);
+      chunked.render(pos < held, n, actual.data() + 4 * pos, 1, 4);
+      pos += n;
+    }
+    if (expected != actual || whole.isIdle() != chunked.isIdle()) {
+      fail("envelopes", "chunked render differs, case " + juce::String(i));
+    }
+  }
+  std::printf("envelopes: %d cases\n", settings.iterations);
+
+  // The chorus works out its LFOs per 64 samples, so chunks are whole LFO
+  // blocks; the resampler takes any output block size.
+  const auto input = makeInput(8192);
+  const auto chorusExpected = renderChorus();
+  const auto chorusInput = makeInput((int)chorusExpected.size() / 2);
+  const int numChecks = juce::jmax(1, settings.iterations / 100);
+  for (int i = 0; i < numChecks; i++) {
+    Chorus chorus;
+    chorus.prepare(engineRate);
+    const int size = (int)chorusInput.size();
+    std::vector<float> left(size), right(size);
+    for (int pos = 0; pos < size;) {
+      const int n = juce::jmin(64 * (1 + random.nextInt(8)), size - pos);
+      chorus.process(chorusInput.data() + pos, left.data() + pos,
+                     right.data() + pos, n);
+      pos += n;
+    }
+    left.insert(left.end(), right.begin(), right.end());
+    if (left != chorusExpected) {
+      fail("chorus", "chunked render differs");
+    }
+
+    const auto whole =
+        resample(input, 48000, 1024, 20000, [] { return 1024; });
+    const auto chunked = resample(input, 48000, 1024, 20000, [this] {
+      return 1 + random.nextInt(1024);
+    });
+    if (whole != chunked) {
+      fail("resampler", "chunked render differs");
+    }
+
+    // An impulse must peak at the latency the plugin reports.
+    const int outputRate = 8000 + random.nextInt(184000);
+    Resampler resampler;
+    resampler.prepare(engineRate, outputRate, 1024, 1);
+    std::vector<float> impulse(4096, 0.0f);
+    impulse[0] = 1;
+    const auto response =
+        resample(impulse, outputRate, 1024, 256, [] { return 1024; });
+    const int peak = (int)(std::max_element(response.begin(), response.end(),
+                                            [](float a, float b) {
+                                              return std::abs(a) < std::abs(b);
+                                            }) -
+                           response.begin());
+    const int latency = resampler.getLatencyInOutputSamples();
+    if (peak != latency) {
+      fail("resampler", "impulse at " + juce::String(peak) +
+                            " for a latency of " + juce::String(latency) +
+                            " at " + juce::String(outputRate) + " Hz");
+    }
+  }
+  std::printf("chorus, resampler: %d cases\n", numChecks);
+
+  // Random notes, pedals and voice limits on every channel, switching MPE
+  // while notes are held. Each part must count exactly its own voices and
+  // its pedal must only hold them.
+  GS1_juceAudioProcessor processor;
+  processor.setPolyphony(GS1_juceAudioProcessor::minPolyphony * 2);
+  processor.prepareToPlay(48000, 256);
+  juce::AudioBuffer<float> buffer(2, 256);
+  PerformanceSettings performance;
+  for (int b = 0; b < numChecks * 10; b++) {
+    juce::MidiBuffer midi;
+    for (int e = random.nextInt(8); e > 0; e--) {
+      const int channel = 1 + random.nextInt(4);
+      const int note = 60 + random.nextInt(6);
+      switch (random.nextInt(6)) {
+      case 0:
+      case 1:
+        midi.addEvent(
+            juce::MidiMessage::noteOn(channel, note, (juce::uint8)100), e);
+        break;
+      case 2:
+      case 3:
+        midi.addEvent(juce::MidiMessage::noteOff(channel, note), e);
+        break;
+      case 4:
+        midi.addEvent(juce::MidiMessage::controllerEvent(
+                          channel, 64, random.nextBool() ? 127 : 0),
+                      e);
+        break;
+      default:
+        processor.setPartVoiceLimit(channel - 1, 1 + random.nextInt(8));
+      }
+    }
+    if (random.nextInt(8) == 0) {
+      performance.mpe = !performance.mpe;
+      processor.patchParameters.load(performance);
+      processor.publishPatch();
+    }
+    buffer.clear();
+    processor.processBlock(buffer, midi);
+
+    int counts[GS1_juceAudioProcessor::numParts] = {};
+    for (int i = 0; i < processor.voices.getNumActive(); i++) {
+      counts[processor.voiceStates[processor.voices.getActiveVoices()[i]]
+                 .part]++;
+    }
+    for (int p = 0; p < GS1_juceAudioProcessor::numParts; p++) {
+      if (processor.parts[p].numVoices != counts[p]) {
+        fail("voice counts", "part " + juce::String(p) + " counts " +
+                                 juce::String(processor.parts[p].numVoices) +
+                                 " voices of " + juce::String(counts[p]) +
+                                 ", block " + juce::String(b));
+      }
+      const int sustained = VoiceAllocator::firstSustainedList + p;
+      for (int v = processor.voices.getFirst(sustained); v >= 0;
+           v = processor.voices.getNext(v)) {
+        if (processor.voiceStates[v].part != p) {
+          fail("voice counts", "pedal of part " + juce::String(p) +
+                                   " holds a voice of part " +
+                                   juce::String(processor.voiceStates[v].part));
+        }
+      }
+    }
+    if (numFailures > 0) {
+      break;
+    }
+  }
+  std::printf("voice allocation: %d blocks\n", numChecks * 10);
+
+  // Snapshots of the engine above with one word of the voice lists set to
+  // -2, which no index or count can be. Restoring must refuse them and
+  // leave the engine as it was.
+  std::vector<uint8_t> engineState(processor.getEngineStateSize());
+  std::vector<uint8_t> resaved(engineState.size());
+  StateWriter listCounter(nullptr, 0);
+  processor.voices.saveState(listCounter);
+  std::vector<uint8_t> lists(listCounter.getSize());
+  StateWriter listWriter(lists.data(), lists.size());
+  processor.voices.saveState(listWriter);
+  if (!processor.saveEngineState(engineState.data(), engineState.size()) ||
+      !processor.restoreEngineState(engineState.data(), engineState.size())) {
+    fail("engine snapshot", "a saved snapshot does not restore");
+  }
+  const size_t listsOffset = (size_t)(
+      std::search(engineState.begin(), engineState.end(), lists.begin(),
+                  lists.end()) -
+      engineState.begin());
+  const int numListWords = (int)(lists.size() / sizeof(int32_t));
+  if (listsOffset == engineState.size()) {
+    fail("engine snapshot", "no voice lists in the snapshot");
+  }
+  for (int i = 0; i < numChecks && listsOffset < engineState.size(); i++) {
+    std::vector<uint8_t> broken = engineState;
+    const int word = random.nextInt(numListWords);
+    const int32_t bad = -2;
+    std::memcpy(broken.data() + listsOffset + word * sizeof(int32_t), &bad,
+                sizeof(bad));
+    if (processor.restoreEngineState(broken.data(), broken.size())) {
+      fail("engine snapshot",
+           "restored with word " + juce::String(word) + " of the lists broken");
+    }
+    if (!processor.saveEngineState(resaved.data(), resaved.size()) ||
+        resaved != engineState) {
+      fail("engine snapshot", "a refused snapshot changed the engine");
+      break;
+    }
+  }
+  std::printf("engine snapshots: %d cases\n", numChecks);
+
+  // Bank files with one field of one record broken: NaN, too big or
+  // negative, which is out of range for every field read as int or float.
+  juce::TemporaryFile bankFile(".gs1b");
+  juce::MemoryBlock bankData;
+  if (!PatchBank::write(bankFile.getFile(), *PatchBank::getFactory()) ||
+      !bankFile.getFile().loadFileAsData(bankData) ||
+      PatchBank::open(bankFile.getFile()) == nullptr) {
+    fail("bank", "the factory bank does not open");
+  }
+  const float badValues[] = {std::numeric_limits<float>::quiet_NaN(), 1e30f,
+                             -1.0f};
+  const int numFields = (int)(sizeof(PatchConsts) / 4);
+  for (int i = 0; i < numChecks; i++) {
+    juce::MemoryBlock broken(bankData.getData(), bankData.getSize());
+    const int record = random.nextInt(PatchBank::getFactory()->getNumPatches());
+    const int field = random.nextInt(numFields);
+    std::memcpy(static_cast<char *>(broken.getData()) +
+                    sizeof(PatchBank::Header) +
+                    record * sizeof(PatchBank::Record) + PatchBank::nameLength +
+                    field * 4,
+                &badValues[random.nextInt(3)], sizeof(float));
+    if (!bankFile.getFile().replaceWithData(broken.getData(),
+                                            broken.getSize()) ||
+        PatchBank::open(bankFile.getFile()) != nullptr) {
+      fail("bank", "opened with field " + juce::String(field) +
+                       " of record " + juce::String(record) + " broken");
+    }
+  }
+  std::printf("bank records: %d cases\n", numChecks);
+
+  // Note cache files with one envelope field of one checkpoint set to -1,
+  // which no stage, level, rate of a silent note or sample count can be.
+  NoteCacheSettings cacheSettings;
+  cacheSettings.lowKey = cacheSettings.highKey = 60;
+  cacheSettings.velocityLayers = 1;
+  const NoteCache emptyCache({0}, {PatchConsts()}, 0, 0, cacheSettings,
+                             NoteCache::checkpointInterval);
+  juce::TemporaryFile cacheFile(".gs1n");
+  juce::MemoryBlock cacheData;
+  if (!emptyCache.save(cacheFile.getFile()) ||
+      !cacheFile.getFile().loadFileAsData(cacheData) ||
+      NoteCache::load(cacheFile.getFile()) == nullptr) {
+    fail("note cache", "an empty cache does not load");
+  }
+  const int numCheckpoints = 2; // Start and end of the one note.
+  const int numProgressFields =
+      (int)(sizeof(OperatorEnvelopes::Progress) / sizeof(int32_t));
+  for (int i = 0; i < numChecks; i++) {
+    juce::MemoryBlock broken(cacheData.getData(), cacheData.getSize());
+    const int checkpoint = random.nextInt(numCheckpoints);
+    const int field = random.nextInt(numProgressFields);
+    const int32_t bad = -1;
+    std::memcpy(static_cast<char *>(broken.getData()) +
+                    sizeof(NoteCache::Header) + sizeof(int32_t) +
+                    sizeof(PatchConsts) +
+                    checkpoint * sizeof(VoiceCheckpoint) +
+                    field * sizeof(int32_t),
+                &bad, sizeof(bad));
+    if (!cacheFile.getFile().replaceWithData(broken.getData(),
+                                             broken.getSize()) ||
+        NoteCache::load(cacheFile.getFile()) != nullptr) {
+      fail("note cache", "loaded with field " + juce::String(field) +
+                             " of checkpoint " + juce::String(checkpoint) +
+                             " broken");
+    }
+  }
+  std::printf("note cache checkpoints: %d cases\n", numChecks);
+
+  std::printf("%d failures\n", numFailures);
+  return numFailures == 0;
+}
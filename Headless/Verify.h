@@ -0,0 +1,50 @@
+/*
+  ==============================================================================
+
+    Golden renders and differential fuzzing of the DSP code.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include "../Source/PluginProcessor.h"
+#include <JuceHeader.h>
+
+struct VerifySettings {
+  // Float renders (chorus, resampler, whole blocks) are compared against
+  // files in this directory within tolerance. Empty skips them.
+  juce::File referenceDir;
+  float tolerance = 1e-5f;
+  bool update = false; // Write new references instead of comparing.
+
+  int iterations = 20000; // Fuzz cases per check.
+  juce::int64 seed = 1;
+};
+
+//==============================================================================
+class Verify {
+public:
+  explicit Verify(const VerifySettings &settings);
+
+  // Hashes the integer engine output per patch and FM routing, the operator
+  // tables and the envelopes and compares them bit for bit with the hashes
+  // recorded in Verify.cpp. With update set, prints a new table instead.
+  // Then compares the float renders if there is a reference directory.
+  bool runGolden();
+
+  // Random operator states through every FM kernel the CPU supports, with
+  // every operator lookup, against the scalar one and the per-voice code,
+  // envelopes and chorus split into random chunks against one go.
+  // Everything must match bit for bit. Then random MIDI, switching MPE with
+  // notes held, must keep the voice count of every part right.
+  bool runFuzz();
+
+private:
+  bool checkRender(const juce::String &name, const std::vector<float> &render);
+  bool fail(const juce::String &check, const juce::String &detail);
+
+  VerifySettings settings;
+  juce::Random random;
+  int numFailures = 0;
+};
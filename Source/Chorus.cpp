@@ -0,0 +1,130 @@
+/*
+  ==============================================================================
+
+    GS1 three-tap chorus.
+
+  ==============================================================================
+*/
+
+#include "Chorus.h"
+
+#include <algorithm>
+#include <cmath>
+
+static constexpr double twoPi = 6.283185307179586;
+
+// The original sweeps 61, 60 and 63 samples at 34687Hz with a 0.529Hz LFO
+// plus a 10x faster one at 1/2.7 of its depth.
+static constexpr double depthMs[Chorus::numTaps] = {1.7586, 1.7297, 1.8163};
+static constexpr double slowHz = 0.529;
+static constexpr double fastHz = 5.29;
+static constexpr float slowGain = 2.7f / 3.7f;
+static constexpr float fastGain = 1.0f / 3.7f;
+
+void Chorus::Phasor::setFrequency(double hz, double sampleRate) {
+  dc = (float)std::cos(twoPi * hz / sampleRate);
+  ds = (float)std::sin(twoPi * hz / sampleRate);
+}
+
+double Chorus::getMaxDelaySeconds() {
+  return *std::max_element(std::begin(depthMs), std::end(depthMs)) * 0.001;
+}
+
+void Chorus::prepare(double sampleRate) {
+  slow.setFrequency(slowHz, sampleRate);
+  fast.setFrequency(fastHz, sampleRate);
+
+  int maxDelay = 0;
+  for (int k = 0; k < numTaps; k++) {
+    depth[k] = (float)(depthMs[k] * 0.001 * sampleRate);
+    maxDelay = std::max(maxDelay, (int)std::ceil(depth[k]));
+    tapCos[k] = (float)std::cos(twoPi * k / numTaps);
+    tapSin[k] = (float)std::sin(twoPi * k / numTaps);
+  }
+
+  // The interpolation reads one sample past the deepest delay, and a whole
+  // LFO block is written before it is read.
+  int size = 1;
+  while (size < maxDelay + 2 + lfoBlock) {
+    size <<= 1;
+  }
+  ring.assign(size, 0.0f);
+  mask = size - 1;
+  reset();
+}
+
+void Chorus::reset() {
+  std::fill(ring.begin(), ring.end(), 0.0f);
+  writePos = 0;
+  slow.c = fast.c = 1;
+  slow.s = fast.s = 0;
+}
+
+void Chorus::process(const float *input, float *left, float *right,
+                     int numSamples) {
+  float delays[numTaps][lfoBlock];
+
+  for (int start = 0; start < numSamples; start += lfoBlock) {
+    const int n = std::min(lfoBlock, numSamples - start);
+
+    for (int i = 0; i < n; i++) {
+      slow.advance();
+      fast.advance();
+      for (int k = 0; k < numTaps; k++) {
+        // sin(phase + k/3 cycle) for both LFOs, mapped to 0..depth.
+        const float lfo =
+            slowGain * (slow.s * tapCos[k] + slow.c * tapSin[k]) +
+            fastGain * (fast.s * tapCos[k] + fast.c * tapSin[k]);
+        delays[k][i] = (lfo + 1.0f) * 0.5f * depth[k];
+      }
+    }
+    slow.normalise();
+    fast.normalise();
+
+    for (int i = 0; i < n; i++) {
+      ring[(writePos + i) & mask] = input[start + i];
+    }
+
+    for (int i = 0; i < n; i++) {
+      float taps[numTaps];
+      for (int k = 0; k < numTaps; k++) {
+        const float delay = delays[k][i];
+        const int whole = (int)delay;
+        const float frac = delay - (float)whole;
+        const int pos = writePos + i - whole;
+        const float a = ring[pos & mask];
+        const float b = ring[(pos - 1) & mask];
+        taps[k] = a + frac * (b - a);
+      }
+      left[start + i] = taps[0] * 0.5f + taps[2];
+      right[start + i] = taps[0] * 0.5f + taps[1];
+    }
+
+    writePos = (writePos + n) & mask;
+  }
+}
+
+//==============================================================================
+void Chorus::saveState(StateWriter &writer) const {
+  for (const auto *phasor : {&slow, &fast}) {
+    writer.write(phasor->c);
+    writer.write(phasor->s);
+  }
+  writer.write(ring.data(), ring.size());
+  writer.write(writePos);
+}
+
+bool Chorus::checkState(StateReader &reader) const {
+  int position = -1;
+  return reader.skip<float>(4) && reader.skip<float>(ring.size()) &&
+         reader.read(position) && position >= 0 && position <= mask;
+}
+
+void Chorus::loadState(StateReader &reader) {
+  for (auto *phasor : {&slow, &fast}) {
+    reader.read(phasor->c);
+    reader.read(phasor->s);
+  }
+  reader.read(ring.data(), ring.size());
+  reader.read(writePos);
+}
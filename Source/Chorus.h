@@ -0,0 +1,71 @@
+/*
+  ==============================================================================
+
+    GS1 three-tap chorus.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include "EngineState.h"
+#include <vector>
+
+// Mono in, stereo out. One ring buffer with three read taps, each swept by a
+// slow and a fast sine LFO a third of a cycle apart; L = A / 2 + C and
+// R = A / 2 + B, no dry signal. Delays and rates are in ms and Hz, so the
+// effect sounds the same at any sample rate.
+class Chorus {
+public:
+  static constexpr int numTaps = 3;
+
+  void prepare(double sampleRate);
+  void reset();
+
+  void process(const float *input, float *left, float *right,
+               int numSamples);
+
+  // How long the taps reach back.
+  static double getMaxDelaySeconds();
+  // After this many samples of zero input the output is exactly zero.
+  int getDrainSamples() const { return (int)ring.size(); }
+
+  // Delay line and LFO phases. The chorus must be prepared at the same
+  // rate as the saved one. checkState() reads past a state and returns
+  // false if loadState() would leave the write position off the ring.
+  void saveState(StateWriter &writer) const;
+  bool checkState(StateReader &reader) const;
+  void loadState(StateReader &reader);
+
+private:
+  // Recursive sine oscillator: a unit phasor rotated once per sample.
+  struct Phasor {
+    float c = 1, s = 0;   // cos, sin of the current phase
+    float dc = 1, ds = 0; // cos, sin of the step
+
+    void setFrequency(double hz, double sampleRate);
+    void advance() {
+      const float c0 = c;
+      c = c0 * dc - s * ds;
+      s = s * dc + c0 * ds;
+    }
+    // Keeps the length at 1 against rounding drift.
+    void normalise() {
+      const float g = 1.5f - 0.5f * (c * c + s * s);
+      c *= g;
+      s *= g;
+    }
+  };
+
+  // LFO values are worked out for this many samples at a time, then the
+  // taps are read in a separate loop.
+  static constexpr int lfoBlock = 64;
+
+  Phasor slow, fast;
+  float depth[numTaps] = {}; // Sweep range in samples.
+  float tapCos[numTaps] = {}, tapSin[numTaps] = {};
+
+  std::vector<float> ring;
+  int mask = 0;
+  int writePos = 0;
+};
@@ -0,0 +1,84 @@
+/*
+  ==============================================================================
+
+    What the editor shows, handed over from the audio thread.
+
+  ==============================================================================
+*/
+
+#include "DisplayFeed.h"
+
+int DisplayFeed::readScope(ScopePoint *dest, int maxPoints) {
+  const auto scope =
+      scopeFifo.read(juce::jmin(maxPoints, scopeFifo.getNumReady()));
+  std::copy_n(points + scope.startIndex1, scope.blockSize1, dest);
+  std::copy_n(points + scope.startIndex2, scope.blockSize2,
+              dest + scope.blockSize1);
+  return scope.blockSize1 + scope.blockSize2;
+}
+
+bool DisplayFeed::readVoices(VoiceFrame &dest) {
+  bool found = false;
+  while (frameFifo.getNumReady() > 0) {
+    const auto scope = frameFifo.read(1);
+    dest = frames[scope.startIndex1];
+    found = true;
+  }
+  return found;
+}
+
+//==============================================================================
+void DisplayFeed::prepare(double sampleRate) {
+  decimation = juce::jmax(1, juce::roundToInt(sampleRate / pointsPerSecond));
+  frameSamples = juce::jmax(1, juce::roundToInt(sampleRate / frameRate));
+  pointSamples = 0;
+  numPending = 0;
+  samplesSinceFrame = 0;
+  peakLoad = 0;
+}
+
+void DisplayFeed::addOutput(const float *left, const float *right,
+                            int numSamples) {
+  for (int i = 0; i < numSamples; i++) {
+    const float sample = (left[i] + right[i]) * 0.5f;
+    if (pointSamples == 0) {
+      point = {sample, sample};
+    } else {
+      point.min = juce::jmin(point.min, sample);
+      point.max = juce::jmax(point.max, sample);
+    }
+    if (++pointSamples == decimation) {
+      pending[numPending++] = point;
+      pointSamples = 0;
+      if (numPending == (int)std::size(pending)) {
+        flushPoints();
+      }
+    }
+  }
+  flushPoints();
+}
+
+void DisplayFeed::flushPoints() {
+  // Whatever doesn't fit is dropped.
+  const auto scope = scopeFifo.write(numPending);
+  std::copy_n(pending, scope.blockSize1, points + scope.startIndex1);
+  std::copy_n(pending + scope.blockSize1, scope.blockSize2,
+              points + scope.startIndex2);
+  numPending = 0;
+}
+
+bool DisplayFeed::isFrameDue(int numSamples, float deadlineRatio) {
+  peakLoad = juce::jmax(peakLoad, deadlineRatio);
+  samplesSinceFrame += numSamples;
+  return samplesSinceFrame >= frameSamples;
+}
+
+void DisplayFeed::pushFrame(VoiceFrame &frame) {
+  frame.cpuLoad = peakLoad;
+  peakLoad = 0;
+  samplesSinceFrame = 0;
+  const auto scope = frameFifo.write(1);
+  if (scope.blockSize1 > 0) {
+    frames[scope.startIndex1] = frame;
+  }
+}
@@ -0,0 +1,85 @@
+/*
+  ==============================================================================
+
+    What the editor shows, handed over from the audio thread.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+#include <atomic>
+
+// Lowest and highest output sample over DisplayFeed::getDecimation()
+// samples, (left + right) / 2 of the main output.
+struct ScopePoint {
+  float min = 0, max = 0;
+};
+
+// Voice activity and CPU load, at most DisplayFeed::frameRate per second.
+struct VoiceFrame {
+  static constexpr int maxVoices = 256;
+
+  int numVoices = 0; // Entries used, the polyphony up to maxVoices.
+  float levels[maxVoices] = {}; // Louder carrier, 0 silent to 1 full scale.
+  uint8_t lists[maxVoices] = {}; // VoiceAllocator::List, every sustained
+                                 // list as firstSustainedList.
+  int numActive = 0; // All of them.
+  float cpuLoad = 0; // Highest deadline ratio since the previous frame.
+};
+
+//==============================================================================
+// Two wait-free single reader FIFOs, like EngineProfiler. The audio thread
+// does no work at all while no reader is attached, and drops data instead
+// of waiting while the reader falls behind. Never read voiceStates from
+// another thread, read this.
+class DisplayFeed {
+public:
+  static constexpr int pointsPerSecond = 4000;
+  static constexpr int frameRate = 60;
+
+  //============================================================================
+  // Reader thread.
+  void attachReader(bool attached) { readerAttached = attached; }
+  // Returns the number of points copied, oldest first.
+  int readScope(ScopePoint *dest, int maxPoints);
+  // The newest frame since the previous call, false if there is none.
+  bool readVoices(VoiceFrame &dest);
+
+  //============================================================================
+  // Audio thread.
+  void prepare(double sampleRate);
+  bool isReaderAttached() const {
+    return readerAttached.load(std::memory_order_relaxed);
+  }
+  int getDecimation() const { return decimation; }
+  void addOutput(const float *left, const float *right, int numSamples);
+  // Counts a block towards the next voice frame, true once one is due.
+  bool isFrameDue(int numSamples, float deadlineRatio);
+  // Sets the CPU load and queues the frame.
+  void pushFrame(VoiceFrame &frame);
+
+private:
+  void flushPoints();
+
+  static constexpr int scopeCapacity = 8192;
+  static constexpr int frameCapacity = 8;
+
+  std::atomic<bool> readerAttached{false};
+
+  juce::AbstractFifo scopeFifo{scopeCapacity};
+  ScopePoint points[scopeCapacity];
+  juce::AbstractFifo frameFifo{frameCapacity};
+  VoiceFrame frames[frameCapacity];
+
+  // Audio thread.
+  int decimation = 1;
+  int frameSamples = 1;
+  ScopePoint point; // Being accumulated.
+  int pointSamples = 0;
+  ScopePoint pending[256];
+  int numPending = 0;
+  int samplesSinceFrame = 0;
+  float peakLoad = 0;
+};
@@ -0,0 +1,97 @@
+/*
+  ==============================================================================
+
+    Per-block cost of the audio thread, handed to any reader thread.
+
+  ==============================================================================
+*/
+
+#include "EngineProfiler.h"
+
+const char *EngineProfiler::getStageName(int stage) {
+  const char *names[] = {"control", "midi", "render", "chorus", "resample"};
+  return names[stage];
+}
+
+EngineProfiler::EngineProfiler()
+    : nsPerTick(1e9 / (double)juce::Time::getHighResolutionTicksPerSecond()) {}
+
+void EngineProfiler::beginBlock(int numSamples, double sampleRate) {
+  current = {};
+  current.samplePosition = samplePosition;
+  current.numSamples = numSamples;
+  samplePosition += numSamples;
+  blockNs = numSamples * 1e9 / sampleRate;
+  blockStart = lastLap = juce::Time::getHighResolutionTicks();
+}
+
+void EngineProfiler::lap(Stage stage) {
+  const auto now = juce::Time::getHighResolutionTicks();
+  current.stageNs[stage] += float((now - lastLap) * nsPerTick);
+  lastLap = now;
+}
+
+void EngineProfiler::endBlock(int activeVoices, int ch1Mode, int ch2Mode) {
+  current.totalNs = float((lastLap - blockStart) * nsPerTick);
+  current.deadlineRatio = blockNs > 0 ? float(current.totalNs / blockNs) : 0;
+  current.activeVoices = activeVoices;
+  current.fmModes = ch1Mode * 4 + ch2Mode;
+
+  const auto scope = fifo.write(1);
+  if (scope.blockSize1 > 0) {
+    blocks[scope.startIndex1] = current;
+  } else {
+    numDropped.fetch_add(1, std::memory_order_relaxed);
+  }
+}
+
+int EngineProfiler::read(BlockProfile *dest, int maxBlocks) {
+  const auto scope = fifo.read(juce::jmin(maxBlocks, fifo.getNumReady()));
+  std::copy_n(blocks + scope.startIndex1, scope.blockSize1, dest);
+  std::copy_n(blocks + scope.startIndex2, scope.blockSize2,
+              dest + scope.blockSize1);
+  return scope.blockSize1 + scope.blockSize2;
+}
+
+//==============================================================================
+juce::String EngineProfiler::getCsvHeader() {
+  juce::String header = "position,samples";
+  for (int s = 0; s < numStages; s++) {
+    header << "," << getStageName(s) << "_ns";
+  }
+  return header + ",total_ns,deadline_ratio,voices,stolen,fm_mode,idle";
+}
+
+static juce::String formatMode(int fmModes) {
+  return juce::String(fmModes / 4) + juce::String(fmModes % 4);
+}
+
+juce::String EngineProfiler::toCsv(const BlockProfile &block) {
+  juce::String line;
+  line << block.samplePosition << "," << block.numSamples;
+  for (int s = 0; s < numStages; s++) {
+    line << "," << juce::String(block.stageNs[s], 0);
+  }
+  line << "," << juce::String(block.totalNs, 0) << ","
+       << juce::String(block.deadlineRatio, 4) << "," << block.activeVoices
+       << "," << block.notesStolen << "," << formatMode(block.fmModes) << ","
+       << (block.idle ? 1 : 0);
+  return line;
+}
+
+juce::String EngineProfiler::toJson(const BlockProfile &block) {
+  juce::String line;
+  line << "{\"position\": " << block.samplePosition
+       << ", \"samples\": " << block.numSamples;
+  for (int s = 0; s < numStages; s++) {
+    line << ", \"" << getStageName(s)
+         << "_ns\": " << juce::String(block.stageNs[s], 0);
+  }
+  line << ", \"total_ns\": " << juce::String(block.totalNs, 0)
+       << ", \"deadline_ratio\": " << juce::String(block.deadlineRatio, 4)
+       << ", \"voices\": " << block.activeVoices
+       << ", \"stolen\": " << block.notesStolen << ", \"fm_mode\": \""
+       << formatMode(block.fmModes)
+       << "\", \"idle\": " << (block.idle ? "true" : "false") << "}";
+  return line;
+}
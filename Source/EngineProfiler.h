@@ -0,0 +1,78 @@
+/*
+  ==============================================================================
+
+    Per-block cost of the audio thread, handed to any reader thread.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+#include <atomic>
+
+// What one processBlock() call cost.
+struct BlockProfile {
+  juce::int64 samplePosition = 0; // Output samples before this block.
+  int numSamples = 0;
+  float stageNs[5] = {}; // See EngineProfiler::Stage.
+  float totalNs = 0;
+  float deadlineRatio = 0; // totalNs over the duration of the block.
+  int activeVoices = 0;    // At the end of the block.
+  int notesStolen = 0;
+  int fmModes = 0; // ch1 * 4 + ch2, the routing the voices rendered with.
+  bool idle = false; // Skipped as silent, see isOutputSilent().
+};
+
+//==============================================================================
+// Always on: the audio thread takes a timestamp per stage change and pushes
+// one BlockProfile per block into a wait-free single reader FIFO. Blocks are
+// dropped, and counted, while the FIFO is full, so a reader that goes away
+// costs nothing.
+class EngineProfiler {
+public:
+  enum Stage {
+    control, // Patch snapshot and program changes.
+    midi,    // MIDI dispatch and voice allocation.
+    render,  // Envelopes and FM kernels.
+    chorus,
+    resample,
+    numStages
+  };
+
+  static const char *getStageName(int stage);
+
+  EngineProfiler();
+
+  //============================================================================
+  // Audio thread.
+  void beginBlock(int numSamples, double sampleRate);
+  // Charges the time since the previous lap to the stage.
+  void lap(Stage stage);
+  void noteStolen() { current.notesStolen++; }
+  void idleBlock() { current.idle = true; }
+  void endBlock(int activeVoices, int ch1Mode, int ch2Mode);
+  const BlockProfile &getLastBlock() const { return current; }
+
+  //============================================================================
+  // Reader thread. Returns the number of blocks copied, oldest first.
+  int read(BlockProfile *dest, int maxBlocks);
+  juce::uint64 getNumDropped() const { return numDropped; }
+
+  static juce::String getCsvHeader();
+  static juce::String toCsv(const BlockProfile &block);
+  static juce::String toJson(const BlockProfile &block);
+
+private:
+  static constexpr int capacity = 4096;
+
+  juce::AbstractFifo fifo{capacity};
+  BlockProfile blocks[capacity];
+  std::atomic<juce::uint64> numDropped{0};
+
+  double nsPerTick;
+  BlockProfile current;
+  juce::int64 blockStart = 0, lastLap = 0;
+  juce::int64 samplePosition = 0;
+  double blockNs = 0;
+};
@@ -0,0 +1,81 @@
+/*
+  ==============================================================================
+
+    Raw byte streams for engine snapshots, see
+    GS1_juceAudioProcessor::saveEngineState().
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+// Copies trivially copyable values into caller memory, never allocates.
+// With too little room it keeps counting but stops writing, so a writer on
+// a null buffer measures the size of a state.
+class StateWriter {
+public:
+  StateWriter(void *dest, size_t capacity)
+      : dest(static_cast<uint8_t *>(dest)), capacity(capacity) {}
+
+  template <class T> void write(const T *values, size_t count) {
+    static_assert(std::is_trivially_copyable_v<T>);
+    const size_t bytes = sizeof(T) * count;
+    if (dest != nullptr && size + bytes <= capacity) {
+      std::memcpy(dest + size, values, bytes);
+    }
+    size += bytes;
+  }
+  template <class T> void write(const T &value) { write(&value, 1); }
+
+  size_t getSize() const { return size; }
+  bool isComplete() const { return dest != nullptr && size <= capacity; }
+
+private:
+  uint8_t *dest;
+  size_t capacity;
+  size_t size = 0;
+};
+
+// Reads back what a StateWriter wrote, in the same order. Reading past the
+// end leaves the values alone and returns false.
+class StateReader {
+public:
+  StateReader(const void *data, size_t size)
+      : data(static_cast<const uint8_t *>(data)), size(size) {}
+
+  template <class T> bool read(T *values, size_t count) {
+    static_assert(std::is_trivially_copyable_v<T>);
+    const size_t bytes = sizeof(T) * count;
+    if (position + bytes > size) {
+      position = size;
+      return false;
+    }
+    std::memcpy(values, data + position, bytes);
+    position += bytes;
+    return true;
+  }
+  template <class T> bool read(T &value) { return read(&value, 1); }
+
+  // Moves past count values without reading them, for checking a state.
+  template <class T> bool skip(size_t count) {
+    const size_t bytes = sizeof(T) * count;
+    if (position + bytes > size) {
+      position = size;
+      return false;
+    }
+    position += bytes;
+    return true;
+  }
+
+  size_t getPosition() const { return position; }
+
+private:
+  const uint8_t *data;
+  size_t size;
+  size_t position = 0;
+};
@@ -0,0 +1,172 @@
+/*
+  ==============================================================================
+
+    GS1 operator envelopes in fixed point.
+
+  ==============================================================================
+*/
+
+#include "Envelope.h"
+
+#include <algorithm>
+#include <cmath>
+
+static int32_t toRate(float stepsPerSample) {
+  return std::max<int32_t>(1, (int32_t)std::lround(stepsPerSample * 256.0f));
+}
+
+int64_t OperatorEnvelopes::getStageSamples(float stepsPerSample) {
+  return fullScale / toRate(stepsPerSample);
+}
+
+void OperatorEnvelopes::start(const float *attackSteps,
+                              const float *decaySteps,
+                              const float *releaseSteps,
+                              const int *sustain, const int *baseAmp) {
+  for (int n = 0; n < 4; n++) {
+    attackRates[n] = toRate(attackSteps[n]);
+    decayRates[n] = toRate(decaySteps[n]);
+    releaseRates[n] = toRate(releaseSteps[n]);
+    sustainLevels[n] = std::clamp(sustain[n] << 8, 0, fullScale);
+    baseAmps[n] = baseAmp[n];
+    levels[n] = 0;
+    enterStage(n, attack);
+  }
+}
+
+void OperatorEnvelopes::enterStage(int op, Stage stage) {
+  stages[op] = stage;
+  switch (stage) {
+  case attack:
+    rates[op] = attackRates[op];
+    remaining[op] = (fullScale - levels[op]) / rates[op];
+    break;
+  case decay:
+    levels[op] = fullScale;
+    rates[op] = -decayRates[op];
+    remaining[op] = (levels[op] - sustainLevels[op]) / decayRates[op];
+    break;
+  case release:
+    rates[op] = -releaseRates[op];
+    remaining[op] = levels[op] / releaseRates[op];
+    break;
+  case sustain:
+    levels[op] = sustainLevels[op];
+    rates[op] = 0;
+    remaining[op] = 0;
+    break;
+  default:
+    levels[op] = 0;
+    rates[op] = 0;
+    remaining[op] = 0;
+    break;
+  }
+}
+
+void OperatorEnvelopes::render(bool gate, int numSamples, int32_t *amp,
+                               int opStride, int sampleStride) {
+  for (int n = 0; n < 4; n++) {
+    if (!gate && stages[n] != idle && stages[n] != release) {
+      enterStage(n, release);
+    }
+
+    int32_t *out = amp + n * opStride;
+    for (int s = 0; s < numSamples;) {
+      if (rates[n] == 0) { // Sustain or idle: level holds until the gate.
+        const int32_t value = std::min(baseAmps[n] - (levels[n] >> 16), 4095);
+        for (; s < numSamples; s++) {
+          out[s * sampleStride] = value;
+        }
+        break;
+      }
+
+      const int count = std::min(numSamples - s, remaining[n]);
+      int32_t level = levels[n];
+      for (int i = 0; i < count; i++, s++) {
+        level += rates[n];
+        out[s * sampleStride] = std::min(baseAmps[n] - (level >> 16), 4095);
+      }
+      levels[n] = level;
+
+      remaining[n] -= count;
+      if (remaining[n] == 0) {
+        // Land exactly on the target of the stage.
+        switch (stages[n]) {
+        case attack:
+          enterStage(n, decay);
+          break;
+        case decay:
+          enterStage(n, sustain);
+          break;
+        default:
+          enterStage(n, idle);
+          break;
+        }
+      }
+    }
+  }
+}
+
+OperatorEnvelopes::Progress OperatorEnvelopes::getProgress() const {
+  Progress progress;
+  std::copy_n(stages, 4, progress.stages);
+  std::copy_n(levels, 4, progress.levels);
+  std::copy_n(rates, 4, progress.rates);
+  std::copy_n(remaining, 4, progress.remaining);
+  return progress;
+}
+
+void OperatorEnvelopes::setProgress(const Progress &progress) {
+  std::copy_n(progress.stages, 4, stages);
+  std::copy_n(progress.levels, 4, levels);
+  std::copy_n(progress.rates, 4, rates);
+  std::copy_n(progress.remaining, 4, remaining);
+}
+
+bool OperatorEnvelopes::isValid(const Progress &progress) {
+  for (int n = 0; n < 4; n++) {
+    const int32_t level = progress.levels[n];
+    const int32_t rate = progress.rates[n];
+    const int32_t remaining = progress.remaining[n];
+    if (level < 0 || level > fullScale || remaining < 0) {
+      return false;
+    }
+    switch (progress.stages[n]) {
+    case attack:
+      if (rate <= 0) {
+        return false;
+      }
+      break;
+    case decay:
+    case release:
+      if (rate >= 0) {
+        return false;
+      }
+      break;
+    case idle:
+    case sustain:
+      if (rate != 0 || remaining != 0) {
+        return false;
+      }
+      break;
+    default:
+      return false;
+    }
+    const int64_t end = level + (int64_t)rate * remaining;
+    if (end < 0 || end > fullScale) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool OperatorEnvelopes::isValid() const {
+  for (int n = 0; n < 4; n++) {
+    if (attackRates[n] < 1 || decayRates[n] < 1 || releaseRates[n] < 1 ||
+        sustainLevels[n] < 0 || sustainLevels[n] > fullScale ||
+        baseAmps[n] < 4095) {
+      return false;
+    }
+  }
+  return isValid(getProgress());
+}
@@ -0,0 +1,85 @@
+/*
+  ==============================================================================
+
+    GS1 operator envelopes in fixed point.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <cstdint>
+
+// Attack / decay / release envelopes for the four operators of a voice.
+// Levels follow the original 20-bit accumulator (0xFFFFF is full scale) with
+// 8 fractional bits, and every stage is a straight line. Stage ends are
+// worked out when a stage starts and the gate is only looked at once per
+// render() call, so the per-sample work is an add and the attenuation.
+class OperatorEnvelopes {
+public:
+  static constexpr int32_t fullScale = 0xFFFFF << 8;
+
+  enum Stage : int32_t { idle, attack, decay, sustain, release };
+
+  // Restarts all operators from silence. Rates are accumulator steps per
+  // sample and sustain levels accumulator values, both in 20bit units.
+  // baseAmp is the operator attenuation at level 0: key scaling, velocity and
+  // the 4095 offset of a silent operator.
+  void start(const float *attackSteps, const float *decaySteps,
+             const float *releaseSteps, const int *sustain,
+             const int *baseAmp);
+
+  // Writes numSamples of attenuation per operator, clamped to 4095 (muted),
+  // to amp[n * opStride + s * sampleStride]. A closed gate moves every stage
+  // that is not done yet into release.
+  void render(bool gate, int numSamples, int32_t *amp, int opStride,
+              int sampleStride);
+
+  // Samples a stage at this rate takes to cross the whole level range.
+  static int64_t getStageSamples(float stepsPerSample);
+
+  bool isIdle() const {
+    return stages[0] == idle && stages[1] == idle && stages[2] == idle &&
+           stages[3] == idle;
+  }
+
+  // Where the stages are, the part of the state that moves after start().
+  // Setting it on envelopes started the same way continues from there.
+  struct Progress {
+    int32_t stages[4];
+    int32_t levels[4];
+    int32_t rates[4];
+    int32_t remaining[4];
+  };
+  Progress getProgress() const;
+  void setProgress(const Progress &progress);
+  // False for progress render() can't continue from: an unknown stage, a
+  // level out of range or a stage that would end outside it.
+  static bool isValid(const Progress &progress);
+  // The same for the whole state, which also needs rates start() could have
+  // set and attenuations no lower than a silent operator's.
+  bool isValid() const;
+
+  Stage getStage(int op) const { return (Stage)stages[op]; }
+  int32_t getLevel(int op) const { return levels[op]; }
+  // Attenuation the operator is at now, as render() would write it.
+  int32_t getAttenuation(int op) const {
+    return baseAmps[op] - (levels[op] >> 16) < 4095
+               ? baseAmps[op] - (levels[op] >> 16)
+               : 4095;
+  }
+
+private:
+  void enterStage(int op, Stage stage);
+
+  int32_t stages[4] = {idle, idle, idle, idle};
+  int32_t levels[4] = {};
+  int32_t rates[4] = {};     // Added per sample in the current stage.
+  int32_t remaining[4] = {}; // Samples before the next stage.
+
+  int32_t attackRates[4] = {};
+  int32_t decayRates[4] = {};
+  int32_t releaseRates[4] = {};
+  int32_t sustainLevels[4] = {};
+  int32_t baseAmps[4] = {4095, 4095, 4095, 4095};
+};
@@ -0,0 +1,267 @@
+/*
+  ==============================================================================
+
+    Block FM kernel shared by every instruction set. Each FMKernels*.cpp
+    defines a vector-ops struct and includes this file once, inside its
+    target region, so everything here is a template on that struct.
+
+    The ops struct V provides: vec, mask, width, set1, load, store, add,
+    band, bor, bxor, slli<n>, srai<n>, srli<n>, srav (per-lane arithmetic
+    shift), gather (int table lookup), gather16 (int16_t table lookup), lt
+    and select. permute256 (256 entry int table lookup without gathers) is
+    optional and enables FMLookup::shuffle.
+
+    Every FM routing pair and lookup gets its own instantiation, so the
+    sample loop has no routing branches and all variants are bit-exact with
+    each other.
+
+  ==============================================================================
+*/
+
+namespace {
+
+template <class V>
+constexpr bool hasPermute = requires(const int *table, typename V::vec index) {
+  V::permute256(table, index);
+};
+
+template <class V, FMLookup L>
+inline typename V::vec lookup256(const int *table, typename V::vec index) {
+  if constexpr (L == FMLookup::shuffle) {
+    return V::permute256(table, index);
+  } else {
+    return V::gather(table, index);
+  }
+}
+
+// Quarter wave index of a 10bit phase, bit 8 mirrors it.
+template <class V> inline typename V::vec quarterIndex(typename V::vec val) {
+  using vec = typename V::vec;
+  const vec mirror = V::template srai<31>(V::template slli<23>(val)); // bit 8
+  return V::bxor(V::band(val, V::set1(255)), V::band(mirror, V::set1(255)));
+}
+
+template <class V, FMLookup L>
+inline typename V::vec lookupSinV(typename V::vec val) {
+  using vec = typename V::vec;
+  const vec sign = V::template slli<6>(V::band(val, V::set1(512))); // 0x8000
+  return V::bor(lookup256<V, L>(logsinTable, quarterIndex<V>(val)), sign);
+}
+
+template <class V, FMLookup L>
+inline typename V::vec lookupExpV(typename V::vec val) {
+  using vec = typename V::vec;
+  const vec sign = V::template srai<31>(V::template slli<16>(val)); // bit 15
+  const vec index = V::bxor(V::band(val, V::set1(255)), V::set1(255));
+  const vec t = V::template slli<1>(
+      V::bor(lookup256<V, L>(expTable, index), V::set1(32768)));
+  const vec shift = V::band(V::template srai<8>(val), V::set1(0x7F));
+  // -result - 1 == ~result
+  return V::template srai<4>(V::bxor(V::srav(t, shift), sign));
+}
+
+// amp is 0-4095. The fused tables hold the positive half wave, negative
+// outputs are ~x like in lookupExpV().
+template <class V, FMLookup L>
+inline typename V::vec fmOperator(typename V::vec phase, typename V::vec amp) {
+  using vec = typename V::vec;
+  if constexpr (L == FMLookup::twoStage || L == FMLookup::shuffle) {
+    return lookupExpV<V, L>(V::add(lookupSinV<V, L>(phase), amp));
+  } else {
+    const vec sign = V::template srai<31>(V::template slli<22>(phase)); // bit 9
+    const vec index = quarterIndex<V>(phase);
+    vec out;
+    if constexpr (L == FMLookup::fusedExp) {
+      out = V::gather16(fusedTables.exp,
+                        V::add(V::gather(logsinTable, index), amp));
+    } else if constexpr (L == FMLookup::fusedQuarter) {
+      const vec fine = V::template slli<8>(V::band(amp, V::set1(255)));
+      out = V::srav(V::gather16(fusedTables.quarter[0], V::bor(fine, index)),
+                    V::template srai<8>(amp));
+    } else {
+      const vec silent = V::set1(FusedTables::silentAttenuation);
+      const vec row = V::select(V::lt(amp, silent), amp, silent);
+      out = V::gather16(fusedTables.full[0],
+                        V::bor(V::template slli<8>(row), index));
+    }
+    return V::bxor(out, sign);
+  }
+}
+
+// (a + b) / 2, rounding toward zero like C integer division.
+template <class V>
+inline typename V::vec halfSum(typename V::vec a, typename V::vec b) {
+  const typename V::vec sum = V::add(a, b);
+  return V::template srai<1>(V::add(sum, V::template srli<31>(sum)));
+}
+
+// One sample of both operator stacks. 4 modes: norm, pi/2: half intensity
+// modulator self feedback, pi full mod self feedback and cross from other
+// stack. PAE holds the phases of this sample.
+template <class V, FMLookup L, int ch1Mode, int ch2Mode>
+inline typename V::vec
+renderFMStacks(const typename V::vec *PAE, const typename V::vec *amp,
+               typename V::vec &M1, typename V::vec &M2,
+               typename V::vec &M1old1, typename V::vec &M1old2,
+               typename V::vec &M2old1, typename V::vec &M2old2) {
+  using vec = typename V::vec;
+  using mask = typename V::mask;
+
+  const vec ampMax = V::set1(4095);
+  const vec zero = V::set1(0);
+  const vec offset = V::set1(8192);
+  const vec modMask = V::set1(1023);
+  const mask on0 = V::lt(amp[0], ampMax);
+  const mask on1 = V::lt(amp[1], ampMax);
+  const mask on2 = V::lt(amp[2], ampMax);
+  const mask on3 = V::lt(amp[3], ampMax);
+
+  // CHANNEL1
+  if constexpr (ch1Mode == 0 || ch1Mode == 3) { // NORM, CROSS
+    // CROSS uses the opposite modulator.
+    const vec phase = ch1Mode == 3 ? V::add(PAE[2], M2) : PAE[2];
+    M1 = V::select(on2,
+                   V::band(V::template srai<2>(
+                               V::add(fmOperator<V, L>(phase, amp[2]), offset)),
+                           modMask),
+                   ampMax);
+  } else { // PI/2, PI
+    const vec feedback = halfSum<V>(M1old1, M1old2);
+    const vec phase =
+        V::add(PAE[2], ch1Mode == 1 ? V::template srai<3>(feedback)
+                                    : V::template srai<2>(feedback));
+    M1 = V::select(on2,
+                   V::template srai<4>(
+                       V::add(fmOperator<V, L>(phase, amp[2]), offset)),
+                   ampMax);
+    M1old2 = M1old1;
+    M1old1 = M1;
+  }
+  const vec CH1 =
+      V::select(on0, fmOperator<V, L>(V::add(PAE[0], M1), amp[0]), zero);
+
+  // CHANNEL2
+  if constexpr (ch2Mode == 0 || ch2Mode == 3) { // NORM, CROSS
+    const vec phase = ch2Mode == 3 ? V::add(PAE[3], M1) : PAE[3];
+    M2 = V::select(on3,
+                   V::band(V::template srai<2>(
+                               V::add(fmOperator<V, L>(phase, amp[3]), offset)),
+                           modMask),
+                   ampMax);
+  } else { // PI/2, PI
+    const vec feedback = halfSum<V>(M2old1, M2old2);
+    const vec phase =
+        V::add(PAE[3], ch2Mode == 1 ? V::template srai<3>(feedback)
+                                    : V::template srai<2>(feedback));
+    M2 = V::select(on3,
+                   V::template srai<4>(
+                       V::add(fmOperator<V, L>(phase, amp[3]), offset)),
+                   ampMax);
+    M2old2 = M2old1;
+    M2old1 = M2;
+  }
+  const vec CH2 =
+      V::select(on1, fmOperator<V, L>(V::add(PAE[1], M2), amp[1]), zero);
+
+  return V::add(CH1, CH2); // Mix two stacks output.
+}
+
+template <class V, FMLookup L, int ch1Mode, int ch2Mode>
+void renderFMLanes(FMLanes &lanes, const FMAmpBlock &amps, int numSamples,
+                   int32_t *out) {
+  using vec = typename V::vec;
+  constexpr int W = V::width;
+
+  alignas(64) int32_t acc[FMAmpBlock::maxSamples][W] = {};
+
+  const vec phaseMask = V::set1(0xFFFFFFF);
+
+  for (int g = 0; g < lanes.numLanes; g += W) {
+    vec PAI[4], CW[4];
+    for (int n = 0; n < 4; n++) {
+      PAI[n] = V::load(&lanes.PAI[n][g]);
+      CW[n] = V::load(&lanes.CW[n][g]);
+    }
+    vec M1 = V::load(&lanes.M1[g]);
+    vec M2 = V::load(&lanes.M2[g]);
+    vec M1old1 = V::load(&lanes.M1old1[g]);
+    vec M1old2 = V::load(&lanes.M1old2[g]);
+    vec M2old1 = V::load(&lanes.M2old1[g]);
+    vec M2old2 = V::load(&lanes.M2old2[g]);
+
+    for (int s = 0; s < numSamples; s++) {
+      // Update all Phase accumulators..(28bit)
+      vec PAE[4], amp[4];
+      for (int n = 0; n < 4; n++) {
+        PAI[n] = V::band(PAI[n], phaseMask);
+        PAE[n] = V::template srai<18>(PAI[n]);
+        PAI[n] = V::add(PAI[n], CW[n]);
+        amp[n] = V::load(&amps.amp[s][n][g]);
+      }
+      const vec sum = renderFMStacks<V, L, ch1Mode, ch2Mode>(
+          PAE, amp, M1, M2, M1old1, M1old2, M2old1, M2old2);
+      V::store(acc[s], V::add(V::load(acc[s]), sum));
+    }
+
+    for (int n = 0; n < 4; n++) {
+      V::store(&lanes.PAI[n][g], PAI[n]);
+    }
+    V::store(&lanes.M1[g], M1);
+    V::store(&lanes.M2[g], M2);
+    V::store(&lanes.M1old1[g], M1old1);
+    V::store(&lanes.M1old2[g], M1old2);
+    V::store(&lanes.M2old1[g], M2old1);
+    V::store(&lanes.M2old2[g], M2old2);
+  }
+
+  // Mix every voice.
+  for (int s = 0; s < numSamples; s++) {
+    int32_t sum = 0;
+    for (int k = 0; k < W; k++) {
+      sum += acc[s][k];
+    }
+    out[s] = sum;
+  }
+}
+
+// Fills the routing table with one instantiation per mode pair.
+template <class V, FMLookup L, int ch1Mode = 0, int ch2Mode = 0>
+void fillFMKernel(FMKernel &kernel) {
+  kernel.render[ch1Mode][ch2Mode] = renderFMLanes<V, L, ch1Mode, ch2Mode>;
+  if constexpr (ch2Mode < 3) {
+    fillFMKernel<V, L, ch1Mode, ch2Mode + 1>(kernel);
+  } else if constexpr (ch1Mode < 3) {
+    fillFMKernel<V, L, ch1Mode + 1, 0>(kernel);
+  }
+}
+
+// The fused tables must have been built.
+template <class V> FMKernel makeFMKernel(FMLookup lookup) {
+  FMKernel kernel;
+  kernel.laneWidth = V::width;
+  kernel.lookup = lookup;
+  switch (lookup) {
+  case FMLookup::fusedExp:
+    fillFMKernel<V, FMLookup::fusedExp>(kernel);
+    break;
+  case FMLookup::fusedQuarter:
+    fillFMKernel<V, FMLookup::fusedQuarter>(kernel);
+    break;
+  case FMLookup::fusedFull:
+    fillFMKernel<V, FMLookup::fusedFull>(kernel);
+    break;
+  case FMLookup::shuffle:
+    if constexpr (hasPermute<V>) {
+      fillFMKernel<V, FMLookup::shuffle>(kernel);
+      break;
+    }
+    [[fallthrough]];
+  default:
+    kernel.lookup = FMLookup::twoStage;
+    fillFMKernel<V, FMLookup::twoStage>(kernel);
+    break;
+  }
+  return kernel;
+}
+
+} // namespace
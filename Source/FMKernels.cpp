@@ -0,0 +1,91 @@
+/*
+  ==============================================================================
+
+    Block FM kernels: render the operator stacks of many voices at once.
+
+  ==============================================================================
+*/
+
+#include "FMKernels.h"
+#include "Tables.h"
+
+namespace {
+
+// One voice per "vector", plain ints. Reference for the SIMD variants and the
+// fallback for CPUs (or architectures) without them.
+struct ScalarOps {
+  using vec = int32_t;
+  using mask = bool;
+  static constexpr int width = 1;
+
+  static vec set1(int32_t v) { return v; }
+  static vec load(const int32_t *p) { return *p; }
+  static void store(int32_t *p, vec v) { *p = v; }
+  static vec add(vec a, vec b) { return a + b; }
+  static vec band(vec a, vec b) { return a & b; }
+  static vec bor(vec a, vec b) { return a | b; }
+  static vec bxor(vec a, vec b) { return a ^ b; }
+  template <int n> static vec slli(vec a) {
+    return (int32_t)((uint32_t)a << n);
+  }
+  template <int n> static vec srai(vec a) { return a >> n; }
+  template <int n> static vec srli(vec a) {
+    return (int32_t)((uint32_t)a >> n);
+  }
+  static vec srav(vec a, vec n) { return a >> n; }
+  static vec gather(const int *table, vec index) { return table[index]; }
+  static vec gather16(const int16_t *table, vec index) { return table[index]; }
+  static mask lt(vec a, vec b) { return a < b; }
+  static vec select(mask m, vec a, vec b) { return m ? a : b; }
+};
+
+} // namespace
+
+#include "FMKernelBody.h"
+
+#if FM_KERNELS_X86
+FMKernel getFMKernelSSE41(FMLookup lookup);
+FMKernel getFMKernelAVX2(FMLookup lookup);
+FMKernel getFMKernelAVX512(FMLookup lookup);
+#endif
+
+FMKernel getFMKernel(FMKernelIsa isa, FMLookup lookup) {
+  if (lookup != FMLookup::twoStage && lookup != FMLookup::shuffle) {
+    buildFusedTables();
+  }
+#if FM_KERNELS_X86
+  switch (isa) {
+  case FMKernelIsa::sse41:
+    return getFMKernelSSE41(lookup);
+  case FMKernelIsa::avx2:
+    return getFMKernelAVX2(lookup);
+  case FMKernelIsa::avx512:
+    return getFMKernelAVX512(lookup);
+  default:
+    break;
+  }
+#endif
+  return makeFMKernel<ScalarOps>(lookup);
+}
+
+template <int ch1Mode, int ch2Mode>
+static int32_t renderFMSample(const int32_t *PAE, const int32_t *amp,
+                              int32_t &M1, int32_t &M2, int32_t &M1old1,
+                              int32_t &M1old2, int32_t &M2old1,
+                              int32_t &M2old2) {
+  return renderFMStacks<ScalarOps, FMLookup::twoStage, ch1Mode, ch2Mode>(
+      PAE, amp, M1, M2, M1old1, M1old2, M2old1, M2old2);
+}
+
+FMSampleFn getFMSampleFn(int ch1Mode, int ch2Mode) {
+  static const FMSampleFn table[numFMModes][numFMModes] = {
+      {renderFMSample<0, 0>, renderFMSample<0, 1>, renderFMSample<0, 2>,
+       renderFMSample<0, 3>},
+      {renderFMSample<1, 0>, renderFMSample<1, 1>, renderFMSample<1, 2>,
+       renderFMSample<1, 3>},
+      {renderFMSample<2, 0>, renderFMSample<2, 1>, renderFMSample<2, 2>,
+       renderFMSample<2, 3>},
+      {renderFMSample<3, 0>, renderFMSample<3, 1>, renderFMSample<3, 2>,
+       renderFMSample<3, 3>}};
+  return table[ch1Mode][ch2Mode];
+}
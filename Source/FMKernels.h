@@ -0,0 +1,85 @@
+/*
+  ==============================================================================
+
+    Block FM kernels: render the operator stacks of many voices at once.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <cstdint>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) ||           \
+    defined(_M_IX86)
+#define FM_KERNELS_X86 1
+#else
+#define FM_KERNELS_X86 0
+#endif
+
+// Operator state of the voices being rendered, one lane per voice
+// (structure of arrays). Lanes past the sounding voices are padding and are
+// kept muted through their attenuation.
+struct FMLanes {
+  static constexpr int maxLanes = 32;
+
+  alignas(64) int32_t PAI[4][maxLanes]; // 28bit phase accumulators
+  alignas(64) int32_t CW[4][maxLanes];  // C1,C2,M1,M2
+  alignas(64) int32_t M1[maxLanes];
+  alignas(64) int32_t M2[maxLanes];
+  alignas(64) int32_t M1old1[maxLanes];
+  alignas(64) int32_t M1old2[maxLanes];
+  alignas(64) int32_t M2old1[maxLanes];
+  alignas(64) int32_t M2old2[maxLanes];
+  int numLanes = 0; // Multiple of the kernel width.
+};
+
+// Per-sample operator attenuation (AMP[] in VoiceState) for every lane,
+// produced by the envelopes ahead of the kernel.
+struct FMAmpBlock {
+  static constexpr int maxSamples = 32;
+
+  alignas(64) int32_t amp[maxSamples][4][FMLanes::maxLanes];
+};
+
+// Renders numSamples of every lane and writes the per-sample sum of
+// CH1 + CH2 over all lanes to out.
+using FMKernelFn = void (*)(FMLanes &lanes, const FMAmpBlock &amps,
+                            int numSamples, int32_t *out);
+
+enum class FMKernelIsa { scalar, sse41, avx2, avx512 };
+
+// How an operator turns phase and attenuation into output. All of them are
+// bit-exact with each other, see FusedTables in Tables.h for the sizes.
+enum class FMLookup {
+  twoStage,     // lookupExp(lookupSin(phase) + amp), two 1 kB tables.
+  fusedExp,     // Sine table, then one load for the whole exponent.
+  fusedQuarter, // One load per operator plus a shift, 128 kB.
+  fusedFull,    // One load per operator, 1.7 MB.
+  shuffle       // Two-stage from registers with permutes, AVX-512 only.
+};
+
+// FM routing for CH1 and CH2: 0=NORM 1=PI/2 2=PI 3=CROSS.
+constexpr int numFMModes = 4;
+
+struct FMKernel {
+  FMKernelFn render[numFMModes][numFMModes] = {}; // [ch1Mode][ch2Mode]
+  int laneWidth = 1; // Voices per instruction.
+  FMLookup lookup = FMLookup::twoStage; // The one it actually uses.
+};
+
+// The caller checks that the CPU supports the instruction set. Variants
+// that are not compiled for this architecture fall back to scalar, lookups
+// an instruction set can't do fall back to two-stage. Builds the fused
+// tables on first use.
+FMKernel getFMKernel(FMKernelIsa isa, FMLookup lookup = FMLookup::twoStage);
+
+// One sample of a single voice with the scalar kernel, for code that steps
+// voices one at a time. PAE holds the phases of this sample, the modulator
+// feedback is updated in place. Returns CH1 + CH2.
+using FMSampleFn = int32_t (*)(const int32_t *PAE, const int32_t *amp,
+                               int32_t &M1, int32_t &M2, int32_t &M1old1,
+                               int32_t &M1old2, int32_t &M2old1,
+                               int32_t &M2old2);
+
+FMSampleFn getFMSampleFn(int ch1Mode, int ch2Mode);
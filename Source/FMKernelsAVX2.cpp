@@ -0,0 +1,73 @@
+/*
+  ==============================================================================
+
+    AVX2 FM kernel, 8 voices per instruction.
+
+  ==============================================================================
+*/
+
+#include "FMKernels.h"
+#include "Tables.h"
+
+#if FM_KERNELS_X86
+
+#if defined(__clang__)
+#pragma clang attribute push(__attribute__((target("avx2"))),                \
+                             apply_to = function)
+#elif defined(__GNUC__)
+#pragma GCC push_options
+#pragma GCC target("avx2")
+#endif
+
+#include <immintrin.h>
+
+namespace {
+
+struct AVX2Ops {
+  using vec = __m256i;
+  using mask = __m256i;
+  static constexpr int width = 8;
+
+  static vec set1(int32_t v) { return _mm256_set1_epi32(v); }
+  static vec load(const int32_t *p) {
+    return _mm256_load_si256((const vec *)p);
+  }
+  static void store(int32_t *p, vec v) { _mm256_store_si256((vec *)p, v); }
+  static vec add(vec a, vec b) { return _mm256_add_epi32(a, b); }
+  static vec band(vec a, vec b) { return _mm256_and_si256(a, b); }
+  static vec bor(vec a, vec b) { return _mm256_or_si256(a, b); }
+  static vec bxor(vec a, vec b) { return _mm256_xor_si256(a, b); }
+  template <int n> static vec slli(vec a) { return _mm256_slli_epi32(a, n); }
+  template <int n> static vec srai(vec a) { return _mm256_srai_epi32(a, n); }
+  template <int n> static vec srli(vec a) { return _mm256_srli_epi32(a, n); }
+  static vec srav(vec a, vec n) { return _mm256_srav_epi32(a, n); }
+  static vec gather(const int *table, vec index) {
+    return _mm256_i32gather_epi32(table, index, 4);
+  }
+  // Reads 32 bits at each int16_t and keeps the low half, the tables are
+  // padded and their entries positive.
+  static vec gather16(const int16_t *table, vec index) {
+    return band(_mm256_i32gather_epi32((const int *)table, index, 2),
+                set1(0xFFFF));
+  }
+  static mask lt(vec a, vec b) { return _mm256_cmpgt_epi32(b, a); }
+  static vec select(mask m, vec a, vec b) {
+    return _mm256_blendv_epi8(b, a, m);
+  }
+};
+
+} // namespace
+
+#include "FMKernelBody.h"
+
+#if defined(__clang__)
+#pragma clang attribute pop
+#elif defined(__GNUC__)
+#pragma GCC pop_options
+#endif
+
+FMKernel getFMKernelAVX2(FMLookup lookup) {
+  return makeFMKernel<AVX2Ops>(lookup);
+}
+
+#endif
@@ -0,0 +1,85 @@
+/*
+  ==============================================================================
+
+    AVX-512 FM kernel, 16 voices per instruction.
+
+  ==============================================================================
+*/
+
+#include "FMKernels.h"
+#include "Tables.h"
+
+#if FM_KERNELS_X86
+
+#if defined(__clang__)
+#pragma clang attribute push(__attribute__((target("avx512f"))),             \
+                             apply_to = function)
+#elif defined(__GNUC__)
+#pragma GCC push_options
+#pragma GCC target("avx512f")
+#endif
+
+#include <immintrin.h>
+
+namespace {
+
+struct AVX512Ops {
+  using vec = __m512i;
+  using mask = __mmask16;
+  static constexpr int width = 16;
+
+  static vec set1(int32_t v) { return _mm512_set1_epi32(v); }
+  static vec load(const int32_t *p) { return _mm512_load_si512(p); }
+  static void store(int32_t *p, vec v) { _mm512_store_si512(p, v); }
+  static vec add(vec a, vec b) { return _mm512_add_epi32(a, b); }
+  static vec band(vec a, vec b) { return _mm512_and_si512(a, b); }
+  static vec bor(vec a, vec b) { return _mm512_or_si512(a, b); }
+  static vec bxor(vec a, vec b) { return _mm512_xor_si512(a, b); }
+  template <int n> static vec slli(vec a) { return _mm512_slli_epi32(a, n); }
+  template <int n> static vec srai(vec a) { return _mm512_srai_epi32(a, n); }
+  template <int n> static vec srli(vec a) { return _mm512_srli_epi32(a, n); }
+  static vec srav(vec a, vec n) { return _mm512_srav_epi32(a, n); }
+  static vec gather(const int *table, vec index) {
+    return _mm512_i32gather_epi32(index, table, 4);
+  }
+  static vec gather16(const int16_t *table, vec index) {
+    return band(_mm512_i32gather_epi32(index, table, 2), set1(0xFFFF));
+  }
+  // Two-source permutes look up each 32 entry slice of the table, index
+  // bits 5-7 then pick the slice. The table must be 64 byte aligned.
+  static vec permute256(const int *table, vec index) {
+    vec slices[8];
+    for (int k = 0; k < 8; k++) {
+      slices[k] = _mm512_permutex2var_epi32(load(table + 32 * k), index,
+                                            load(table + 32 * k + 16));
+    }
+    for (int bit = 32, n = 8; n > 1; bit <<= 1, n >>= 1) {
+      const mask upper = _mm512_test_epi32_mask(index, set1(bit));
+      for (int k = 0; k < n / 2; k++) {
+        slices[k] = _mm512_mask_blend_epi32(upper, slices[2 * k],
+                                            slices[2 * k + 1]);
+      }
+    }
+    return slices[0];
+  }
+  static mask lt(vec a, vec b) { return _mm512_cmplt_epi32_mask(a, b); }
+  static vec select(mask m, vec a, vec b) {
+    return _mm512_mask_blend_epi32(m, b, a);
+  }
+};
+
+} // namespace
+
+#include "FMKernelBody.h"
+
+#if defined(__clang__)
+#pragma clang attribute pop
+#elif defined(__GNUC__)
+#pragma GCC pop_options
+#endif
+
+FMKernel getFMKernelAVX512(FMLookup lookup) {
+  return makeFMKernel<AVX512Ops>(lookup);
+}
+
+#endif
@@ -0,0 +1,77 @@
+/*
+  ==============================================================================
+
+    SSE4.1 FM kernel, 4 voices per instruction. SSE has no per-lane shifts
+    or gathers, so those go through memory.
+
+  ==============================================================================
+*/
+
+#include "FMKernels.h"
+#include "Tables.h"
+
+#if FM_KERNELS_X86
+
+#if defined(__clang__)
+#pragma clang attribute push(__attribute__((target("sse4.1"))),              \
+                             apply_to = function)
+#elif defined(__GNUC__)
+#pragma GCC push_options
+#pragma GCC target("sse4.1")
+#endif
+
+#include <immintrin.h>
+
+namespace {
+
+struct SSE41Ops {
+  using vec = __m128i;
+  using mask = __m128i;
+  static constexpr int width = 4;
+
+  static vec set1(int32_t v) { return _mm_set1_epi32(v); }
+  static vec load(const int32_t *p) { return _mm_load_si128((const vec *)p); }
+  static void store(int32_t *p, vec v) { _mm_store_si128((vec *)p, v); }
+  static vec add(vec a, vec b) { return _mm_add_epi32(a, b); }
+  static vec band(vec a, vec b) { return _mm_and_si128(a, b); }
+  static vec bor(vec a, vec b) { return _mm_or_si128(a, b); }
+  static vec bxor(vec a, vec b) { return _mm_xor_si128(a, b); }
+  template <int n> static vec slli(vec a) { return _mm_slli_epi32(a, n); }
+  template <int n> static vec srai(vec a) { return _mm_srai_epi32(a, n); }
+  template <int n> static vec srli(vec a) { return _mm_srli_epi32(a, n); }
+  static vec srav(vec a, vec n) {
+    alignas(16) int32_t x[4], s[4];
+    store(x, a);
+    store(s, n);
+    return _mm_setr_epi32(x[0] >> s[0], x[1] >> s[1], x[2] >> s[2],
+                          x[3] >> s[3]);
+  }
+  static vec gather(const int *table, vec index) {
+    return _mm_setr_epi32(
+        table[_mm_extract_epi32(index, 0)], table[_mm_extract_epi32(index, 1)],
+        table[_mm_extract_epi32(index, 2)], table[_mm_extract_epi32(index, 3)]);
+  }
+  static vec gather16(const int16_t *table, vec index) {
+    return _mm_setr_epi32(
+        table[_mm_extract_epi32(index, 0)], table[_mm_extract_epi32(index, 1)],
+        table[_mm_extract_epi32(index, 2)], table[_mm_extract_epi32(index, 3)]);
+  }
+  static mask lt(vec a, vec b) { return _mm_cmplt_epi32(a, b); }
+  static vec select(mask m, vec a, vec b) { return _mm_blendv_epi8(b, a, m); }
+};
+
+} // namespace
+
+#include "FMKernelBody.h"
+
+#if defined(__clang__)
+#pragma clang attribute pop
+#elif defined(__GNUC__)
+#pragma GCC pop_options
+#endif
+
+FMKernel getFMKernelSSE41(FMLookup lookup) {
+  return makeFMKernel<SSE41Ops>(lookup);
+}
+
+#endif
@@ -0,0 +1,255 @@
+/*
+  ==============================================================================
+
+    Held notes rendered ahead, for playback rigs that can't afford the FM
+    engine at full polyphony.
+
+  ==============================================================================
+*/
+
+#include "NoteCache.h"
+#include <algorithm>
+#include <cstring>
+#include <limits>
+
+NoteCache::NoteCache(std::vector<int> numbers,
+                     std::vector<PatchConsts> patchData, int ch1Mode,
+                     int ch2Mode, const NoteCacheSettings &settings,
+                     int numSamples)
+    : header(makeHeader(ch1Mode, ch2Mode, (int)numbers.size(), settings,
+                        numSamples)),
+      patchNumbers(std::move(numbers)), patches(std::move(patchData)) {
+  allocate();
+}
+
+NoteCache::Header NoteCache::makeHeader(int ch1Mode, int ch2Mode,
+                                        int numPatches,
+                                        const NoteCacheSettings &settings,
+                                        int numSamples) {
+  Header header = {};
+  header.magic = magic;
+  header.version = version;
+  header.checkpointSize = sizeof(VoiceCheckpoint);
+  header.fmModes[0] = ch1Mode;
+  header.fmModes[1] = ch2Mode;
+  header.numPatches = numPatches;
+  header.lowKey = juce::jlimit(0, 127, settings.lowKey);
+  header.highKey = juce::jlimit(header.lowKey, 127, settings.highKey);
+  header.velocityLayers = juce::jlimit(1, 127, settings.velocityLayers);
+  header.numSamples = roundUpSamples(numSamples);
+  return header;
+}
+
+int NoteCache::roundUpSamples(int numSamples) {
+  return juce::jmax(1, (numSamples + checkpointInterval - 1) /
+                           checkpointInterval) *
+         checkpointInterval;
+}
+
+// Samples and checkpoints of one note.
+size_t NoteCache::getNoteBytes(int numSamples) {
+  return (size_t)numSamples * sizeof(int16_t) +
+         (size_t)getCheckpointsPerNote(numSamples) * sizeof(VoiceCheckpoint);
+}
+
+// Divides rather than multiplies, the product may not fit size_t. Notes are
+// numbered by int.
+bool NoteCache::fits(size_t numPatches, const NoteCacheSettings &settings,
+                     int numSamples) {
+  const Header header = makeHeader(0, 0, 0, settings, numSamples);
+  const size_t notesPerPatch =
+      (size_t)(header.highKey - header.lowKey + 1) * header.velocityLayers;
+  const size_t maxNotes =
+      juce::jmin(settings.maxBytes / getNoteBytes(header.numSamples),
+                 (size_t)std::numeric_limits<int>::max());
+  return numPatches <= maxNotes / notesPerPatch;
+}
+
+void NoteCache::allocate() {
+  const size_t numNotes = (size_t)header.numPatches *
+                          (header.highKey - header.lowKey + 1) *
+                          header.velocityLayers;
+  const size_t perNote = (size_t)getCheckpointsPerNote(header.numSamples);
+  checkpoints.resize(numNotes * perNote);
+  samples.resize(numNotes * header.numSamples);
+  notes.resize(numNotes);
+  for (size_t n = 0; n < numNotes; n++) {
+    notes[n].samples = getSamples((int)n);
+    notes[n].checkpoints = getCheckpoints((int)n);
+  }
+}
+
+int16_t *NoteCache::getSamples(int note) {
+  return samples.data() + (size_t)note * header.numSamples;
+}
+
+VoiceCheckpoint *NoteCache::getCheckpoints(int note) {
+  return checkpoints.data() +
+         (size_t)note * getCheckpointsPerNote(header.numSamples);
+}
+
+size_t NoteCache::getMemoryBytes() const {
+  return samples.size() * sizeof(int16_t) +
+         checkpoints.size() * sizeof(VoiceCheckpoint);
+}
+
+//==============================================================================
+// MIDI velocity 1-127 in equal layers.
+int NoteCache::getLayer(int velocity) const {
+  return juce::jlimit(0, 126, velocity - 1) * header.velocityLayers / 127;
+}
+
+// The middle of the layer, the velocity itself with 127 layers.
+int NoteCache::getVelocity(int layer) const {
+  return 1 + (2 * layer + 1) * 127 / (2 * header.velocityLayers);
+}
+
+int NoteCache::getNoteIndex(int slot, int key, int layer) const {
+  return (slot * (header.highKey - header.lowKey + 1) + key - header.lowKey) *
+             header.velocityLayers +
+         layer;
+}
+
+// The place of a bank patch in the cache, -1 if it is not cached.
+int NoteCache::getSlot(int patch) const {
+  const auto it =
+      std::lower_bound(patchNumbers.begin(), patchNumbers.end(), patch);
+  return it != patchNumbers.end() && *it == patch
+             ? (int)(it - patchNumbers.begin())
+             : -1;
+}
+
+bool NoteCache::isCurrent(int patch, const PatchConsts &data,
+                          const int *fmModes) const {
+  const int slot = getSlot(patch);
+  return slot >= 0 && fmModes[0] == header.fmModes[0] &&
+         fmModes[1] == header.fmModes[1] &&
+         std::memcmp(&patches[slot], &data, sizeof(data)) == 0;
+}
+
+const CachedNote *NoteCache::find(int patch, const PatchConsts &data,
+                                  const int *fmModes, int key,
+                                  int velocity) const {
+  if (key < header.lowKey || key > header.highKey ||
+      !isCurrent(patch, data, fmModes)) {
+    return nullptr;
+  }
+  return &notes[getNoteIndex(getSlot(patch), key, getLayer(velocity))];
+}
+
+bool NoteCache::matches(const std::vector<int> &numbers,
+                        const std::vector<PatchConsts> &patchData,
+                        int ch1Mode, int ch2Mode,
+                        const NoteCacheSettings &settings,
+                        int numSamples) const {
+  return numbers == patchNumbers && patchData.size() == patches.size() &&
+         std::memcmp(patchData.data(), patches.data(),
+                     patches.size() * sizeof(PatchConsts)) == 0 &&
+         ch1Mode == header.fmModes[0] && ch2Mode == header.fmModes[1] &&
+         settings.lowKey == header.lowKey &&
+         settings.highKey == header.highKey &&
+         settings.velocityLayers == header.velocityLayers &&
+         roundUpSamples(numSamples) == header.numSamples;
+}
+
+//==============================================================================
+juce::File NoteCache::getFileFor(const juce::File &bankFile) {
+  return bankFile.withFileExtension(".gs1n");
+}
+
+bool NoteCache::save(const juce::File &file) const {
+  file.deleteFile();
+  juce::FileOutputStream stream(file);
+  if (!stream.openedOk()) {
+    return false;
+  }
+  return stream.write(&header, sizeof(header)) &&
+         stream.write(patchNumbers.data(),
+                      patchNumbers.size() * sizeof(int32_t)) &&
+         stream.write(patches.data(), patches.size() * sizeof(PatchConsts)) &&
+         stream.write(checkpoints.data(),
+                      checkpoints.size() * sizeof(VoiceCheckpoint)) &&
+         stream.write(samples.data(), samples.size() * sizeof(int16_t));
+}
+
+// A voice continues from it on the audio thread, so a damaged file must not
+// get that far. Modulator outputs are 0-1023, or 4095 for a muted operator.
+static bool isValid(const VoiceCheckpoint &checkpoint) {
+  for (const int32_t output :
+       {checkpoint.M1, checkpoint.M2, checkpoint.M1old1, checkpoint.M1old2,
+        checkpoint.M2old1, checkpoint.M2old2}) {
+    if (output < 0 || output > 4095) {
+      return false;
+    }
+  }
+  return OperatorEnvelopes::isValid(checkpoint.envelopes);
+}
+
+// Copied out of the mapping rather than used in place: a page fault on the
+// audio thread the first time a note plays would cost more than the engine.
+std::unique_ptr<NoteCache> NoteCache::load(const juce::File &file) {
+#if JUCE_BIG_ENDIAN
+  return nullptr;
+#else
+  juce::MemoryMappedFile mapping(file, juce::MemoryMappedFile::readOnly,
+                                 false);
+  const auto size = (size_t)mapping.getSize();
+  const auto *data = static_cast<const char *>(mapping.getData());
+  if (data == nullptr || size < sizeof(Header)) {
+    return nullptr;
+  }
+
+  std::unique_ptr<NoteCache> cache(new NoteCache());
+  auto &header = cache->header;
+  std::memcpy(&header, data, sizeof(Header));
+  if (header.magic != magic || header.version != version ||
+      header.checkpointSize != sizeof(VoiceCheckpoint) ||
+      header.numPatches < 1 || header.numPatches > 1000000 ||
+      header.lowKey < 0 || header.highKey < header.lowKey ||
+      header.highKey > 127 || header.velocityLayers < 1 ||
+      header.velocityLayers > 127 || header.numSamples < 1 ||
+      header.numSamples % checkpointInterval != 0) {
+    return nullptr;
+  }
+  const size_t numNotes = (size_t)header.numPatches *
+                          (header.highKey - header.lowKey + 1) *
+                          header.velocityLayers;
+  if (numNotes > size / getNoteBytes(header.numSamples) ||
+      numNotes > (size_t)std::numeric_limits<int>::max()) {
+    return nullptr;
+  }
+  const size_t numberBytes = header.numPatches * sizeof(int32_t);
+  const size_t patchBytes = header.numPatches * sizeof(PatchConsts);
+  const size_t checkpointBytes = numNotes *
+                                 getCheckpointsPerNote(header.numSamples) *
+                                 sizeof(VoiceCheckpoint);
+  const size_t sampleBytes = numNotes * header.numSamples * sizeof(int16_t);
+  if (size != sizeof(Header) + numberBytes + patchBytes + checkpointBytes +
+                  sampleBytes) {
+    return nullptr;
+  }
+
+  data += sizeof(Header);
+  auto &numbers = cache->patchNumbers;
+  numbers.resize(header.numPatches);
+  std::memcpy(numbers.data(), data, numberBytes);
+  for (int i = 0; i < header.numPatches; i++) {
+    if (numbers[i] < 0 || (i > 0 && numbers[i] <= numbers[i - 1])) {
+      return nullptr; // find() needs them ascending.
+    }
+  }
+  data += numberBytes;
+  cache->patches.resize(header.numPatches);
+  cache->allocate();
+  std::memcpy(cache->patches.data(), data, patchBytes);
+  std::memcpy(cache->checkpoints.data(), data + patchBytes, checkpointBytes);
+  for (const auto &checkpoint : cache->checkpoints) {
+    if (!isValid(checkpoint)) {
+      return nullptr;
+    }
+  }
+  std::memcpy(cache->samples.data(), data + patchBytes + checkpointBytes,
+              sampleBytes);
+  return cache;
+#endif
+}
@@ -0,0 +1,150 @@
+/*
+  ==============================================================================
+
+    Held notes rendered ahead, for playback rigs that can't afford the FM
+    engine at full polyphony.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include "Envelope.h"
+#include "Patch.h"
+#include <memory>
+#include <vector>
+
+// What a voice needs to continue live from a point of a cached note, on top
+// of what noteOn() set up.
+struct VoiceCheckpoint {
+  OperatorEnvelopes::Progress envelopes;
+  int32_t PAI[4];
+  int32_t M1, M2;
+  int32_t M1old1, M1old2;
+  int32_t M2old1, M2old2;
+};
+
+// The first numSamples of one held note: the voice output per engine sample,
+// exact, and the voice state before every checkpointInterval samples up to
+// and including the end. Dense enough that a voice leaving the cache catches
+// up in a few dozen samples.
+struct CachedNote {
+  const int16_t *samples = nullptr;
+  const VoiceCheckpoint *checkpoints = nullptr;
+};
+
+struct NoteCacheSettings {
+  double seconds = 1.0;   // Held time rendered per note.
+  int velocityLayers = 4; // Up to 127, which is exact.
+  int lowKey = 21;        // MIDI notes, A0
+  int highKey = 108;      // to C8.
+  // Bank patches to render, empty for those the parts play. Notes of other
+  // patches play live.
+  std::vector<int> patches;
+  size_t maxBytes = size_t(1) << 30; // Bigger caches are refused.
+};
+
+//==============================================================================
+// Every (patch, key, velocity layer) of some patches of a bank at one FM
+// routing, rendered by the per-voice engine. A note plays the velocity in the
+// middle of its layer. The samples of a voice fit 16 bits and a checkpoint
+// takes 104 bytes, so a note costs about 125 kB a second: 88 keys of 4 layers
+// take 44 MB per patch.
+//
+// GS1N file: a Header, the bank numbers of the patches, the patches it was
+// rendered from, the checkpoints and the samples, all as laid out in memory
+// and little endian. Written next to the bank.
+class NoteCache {
+public:
+  static constexpr uint32_t magic = 0x4e315347; // "GS1N"
+  static constexpr uint32_t version = 3;
+  static constexpr int checkpointInterval = 64;
+
+  struct Header {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t checkpointSize; // sizeof(VoiceCheckpoint), catches layout
+                             // changes.
+    int32_t fmModes[2];
+    int32_t numPatches; // Cached ones, not the bank's.
+    int32_t lowKey, highKey;
+    int32_t velocityLayers;
+    int32_t numSamples; // Per note, a multiple of checkpointInterval.
+  };
+
+  // Empty notes of the given bank patches, in ascending order, to be filled
+  // by whoever renders them. numSamples is rounded up to whole checkpoint
+  // intervals.
+  NoteCache(std::vector<int> patchNumbers, std::vector<PatchConsts> patches,
+            int ch1Mode, int ch2Mode, const NoteCacheSettings &settings,
+            int numSamples);
+
+  // False if a cache of numPatches would take more than settings.maxBytes.
+  static bool fits(size_t numPatches, const NoteCacheSettings &settings,
+                   int numSamples);
+
+  // nullptr if the file is not a valid cache.
+  static std::unique_ptr<NoteCache> load(const juce::File &file);
+  bool save(const juce::File &file) const;
+
+  // bank.gs1n next to bank.gs1b.
+  static juce::File getFileFor(const juce::File &bankFile);
+
+  // True if it was rendered from exactly these patches and settings.
+  bool matches(const std::vector<int> &patchNumbers,
+               const std::vector<PatchConsts> &patches, int ch1Mode,
+               int ch2Mode, const NoteCacheSettings &settings,
+               int numSamples) const;
+
+  int getNumSamples() const { return header.numSamples; }
+  int getNumNotes() const { return (int)notes.size(); }
+  int getLowKey() const { return header.lowKey; }
+  int getHighKey() const { return header.highKey; }
+  int getNumLayers() const { return header.velocityLayers; }
+  size_t getMemoryBytes() const;
+
+  // The velocity a note of this velocity plays from the cache.
+  int getLayerVelocity(int velocity) const {
+    return getVelocity(getLayer(velocity));
+  }
+  int getVelocity(int layer) const;
+
+  // The note a voice can play, nullptr if it is not cached or the patch or
+  // the FM routing has changed since.
+  const CachedNote *find(int patch, const PatchConsts &data,
+                         const int *fmModes, int key, int velocity) const;
+  bool isCurrent(int patch, const PatchConsts &data,
+                 const int *fmModes) const;
+
+  // Notes handed out by find() by number, for engine snapshots.
+  int indexOf(const CachedNote *note) const {
+    return (int)(note - notes.data());
+  }
+  const CachedNote *getNote(int note) const { return &notes[(size_t)note]; }
+
+  // For rendering. Notes are numbered by the place of their patch in the
+  // cache, then key, then layer.
+  int getNoteIndex(int slot, int key, int layer) const;
+  int16_t *getSamples(int note);
+  VoiceCheckpoint *getCheckpoints(int note);
+
+private:
+  NoteCache() = default;
+  static Header makeHeader(int ch1Mode, int ch2Mode, int numPatches,
+                           const NoteCacheSettings &settings, int numSamples);
+  static size_t getNoteBytes(int numSamples);
+  void allocate();
+  int getSlot(int patch) const;
+  int getLayer(int velocity) const;
+  static int roundUpSamples(int numSamples);
+  static int getCheckpointsPerNote(int numSamples) {
+    return numSamples / checkpointInterval + 1;
+  }
+
+  Header header = {};
+  std::vector<int> patchNumbers; // Ascending.
+  std::vector<PatchConsts> patches;
+  std::vector<VoiceCheckpoint> checkpoints;
+  std::vector<int16_t> samples;
+  std::vector<CachedNote> notes;
+};
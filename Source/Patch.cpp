@@ -0,0 +1,264 @@
+/*
+  ==============================================================================
+
+    Patch data, its host parameters and the snapshot the audio thread plays.
+
+  ==============================================================================
+*/
+
+#include "Patch.h"
+
+namespace {
+
+const char *opIDs[] = {"c1", "c2", "m1", "m2"};
+const char *opNames[] = {"C1", "C2", "M1", "M2"};
+
+enum OpParameter {
+  ratio,
+  detune,
+  attack,
+  decay,
+  release,
+  sustainLevel,
+  curveLow,
+  curveHigh,
+  numOpParameters
+};
+
+struct OpParameterInfo {
+  const char *id;
+  const char *name;
+  float min, max;
+  bool integer;
+};
+
+// Attack and release are level steps per sample. At 0 a stage would take
+// the slowest envelope rate, two hours, so 1 (30 seconds) is the slowest.
+const OpParameterInfo opParameterInfos[numOpParameters] = {
+    {"Ratio", "Ratio", 0, 32, false},
+    {"Detune", "Detune", -16, 16, true},
+    {"Attack", "Attack", 1, 16384, false},
+    {"Decay", "Decay", 0, 16, false},
+    {"Release", "Release", 1, 1024, false},
+    {"Sustain", "Sustain", 0, 255, true},
+    {"CurveLow", "Curve Low", 0, 1, false},
+    {"CurveHigh", "Curve High", 0, 1, false},
+};
+
+const float maxDecayScaling = 32;
+
+const char *modeIDs[] = {"ch1Mode", "ch2Mode"};
+const char *modeNames[] = {"CH1 Mode", "CH2 Mode"};
+
+float *getCurve(PatchConsts &patch, int op) {
+  float *curves[] = {patch.C1EC, patch.C2EC, patch.M1EC, patch.M2EC};
+  return curves[op];
+}
+
+const float *getCurve(const PatchConsts &patch, int op) {
+  const float *curves[] = {patch.C1EC, patch.C2EC, patch.M1EC, patch.M2EC};
+  return curves[op];
+}
+
+float getOpValue(const PatchConsts &patch, int op, int index) {
+  switch (index) {
+  case ratio:
+    return patch.Ratio[op];
+  case detune:
+    return (float)patch.Detune[op];
+  case attack:
+    return patch.ATE[op];
+  case decay:
+    return patch.DTE[op];
+  case release:
+    return patch.RTE[op];
+  case sustainLevel:
+    return (float)patch.SL[op];
+  case curveLow:
+    return getCurve(patch, op)[0];
+  default:
+    return getCurve(patch, op)[1];
+  }
+}
+
+void setOpValue(PatchConsts &patch, int op, int index, float value) {
+  switch (index) {
+  case ratio:
+    patch.Ratio[op] = value;
+    break;
+  case detune:
+    patch.Detune[op] = juce::roundToInt(value);
+    break;
+  case attack:
+    patch.ATE[op] = value;
+    break;
+  case decay:
+    patch.DTE[op] = value;
+    break;
+  case release:
+    patch.RTE[op] = value;
+    break;
+  case sustainLevel:
+    patch.SL[op] = juce::roundToInt(value);
+    break;
+  case curveLow:
+    getCurve(patch, op)[0] = value;
+    break;
+  default:
+    getCurve(patch, op)[1] = value;
+    break;
+  }
+}
+
+bool isInRange(float value, float min, float max) {
+  return value >= min && value <= max; // False for NaN.
+}
+
+} // namespace
+
+bool isPlayable(const PatchConsts &patch) {
+  for (int op = 0; op < 4; op++) {
+    for (int index = 0; index < numOpParameters; index++) {
+      const auto &info = opParameterInfos[index];
+      if (!isInRange(getOpValue(patch, op, index), info.min, info.max)) {
+        return false;
+      }
+    }
+    const float *curve = getCurve(patch, op);
+    for (size_t i = 0; i < std::size(patch.C1EC); i++) {
+      if (!isInRange(curve[i], 0, 1)) {
+        return false;
+      }
+    }
+  }
+  return isInRange(patch.DTE1Scaling, 0, maxDecayScaling);
+}
+
+//==============================================================================
+juce::AudioProcessorValueTreeState::ParameterLayout
+PatchParameters::createLayout() {
+  juce::AudioProcessorValueTreeState::ParameterLayout layout;
+  const PatchConsts defaults;
+
+  for (int op = 0; op < 4; op++) {
+    for (int index = 0; index < numOpParameters; index++) {
+      const auto &info = opParameterInfos[index];
+      const juce::String id = juce::String(opIDs[op]) + info.id;
+      const juce::String name = juce::String(opNames[op]) + " " + info.name;
+      const float value = getOpValue(defaults, op, index);
+      if (info.integer) {
+        layout.add(std::make_unique<juce::AudioParameterInt>(
+            juce::ParameterID(id, 1), name, (int)info.min, (int)info.max,
+            (int)value));
+      } else {
+        layout.add(std::make_unique<juce::AudioParameterFloat>(
+            juce::ParameterID(id, 1), name,
+            juce::NormalisableRange<float>(info.min, info.max), value));
+      }
+    }
+  }
+
+  const juce::StringArray modeChoices{"NORM", "PI/2", "PI", "CROSS"};
+  for (int ch = 0; ch < 2; ch++) {
+    layout.add(std::make_unique<juce::AudioParameterChoice>(
+        juce::ParameterID(modeIDs[ch], 1), modeNames[ch], modeChoices, 0));
+  }
+  layout.add(std::make_unique<juce::AudioParameterFloat>(
+      juce::ParameterID("decayScaling", 1), "C2 Decay Scaling",
+      juce::NormalisableRange<float>(0, maxDecayScaling),
+      defaults.DTE1Scaling));
+
+  const PerformanceSettings performance;
+  auto addFloat = [&](const char *id, const char *name, float max,
+                      float value) {
+    layout.add(std::make_unique<juce::AudioParameterFloat>(
+        juce::ParameterID(id, 1), name, juce::NormalisableRange<float>(0, max),
+        value));
+  };
+  addFloat("bendRange", "Pitch Bend Range", 32, performance.bendRange);
+  layout.add(std::make_unique<juce::AudioParameterBool>(
+      juce::ParameterID("mpe", 1), "MPE", performance.mpe));
+  addFloat("mpeBendRange", "MPE Bend Range", 128, performance.mpeBendRange);
+  addFloat("vibratoRate", "Vibrato Rate", 16, performance.vibratoRate);
+  addFloat("vibratoDepth", "Vibrato Depth", 128, performance.vibratoDepth);
+  addFloat("modWheelDepth", "Mod Wheel Depth", 128, performance.modWheelDepth);
+  addFloat("portamento", "Portamento Time", 2, performance.portamentoTime);
+  return layout;
+}
+
+PatchParameters::PatchParameters(juce::AudioProcessorValueTreeState &state) {
+  auto find = [&](const juce::String &id) {
+    ids.add(id);
+    return Parameter{state.getParameter(id), state.getRawParameterValue(id)};
+  };
+  for (int op = 0; op < 4; op++) {
+    for (int index = 0; index < numOpParameters; index++) {
+      opParameters.add(
+          find(juce::String(opIDs[op]) + opParameterInfos[index].id));
+    }
+  }
+  for (int ch = 0; ch < 2; ch++) {
+    modes[ch] = find(modeIDs[ch]);
+  }
+  decayScaling = find("decayScaling");
+  bendRange = find("bendRange");
+  mpe = find("mpe");
+  mpeBendRange = find("mpeBendRange");
+  vibratoRate = find("vibratoRate");
+  vibratoDepth = find("vibratoDepth");
+  modWheelDepth = find("modWheelDepth");
+  portamentoTime = find("portamento");
+}
+
+void PatchParameters::read(PatchConsts &patch, int *fmModes) const {
+  for (int op = 0; op < 4; op++) {
+    for (int index = 0; index < numOpParameters; index++) {
+      setOpValue(patch, op, index,
+                 opParameters[op * numOpParameters + index].value->load());
+    }
+  }
+  for (int ch = 0; ch < 2; ch++) {
+    fmModes[ch] = juce::roundToInt(modes[ch].value->load());
+  }
+  patch.DTE1Scaling = decayScaling.value->load();
+}
+
+void PatchParameters::read(PerformanceSettings &settings) const {
+  settings.bendRange = bendRange.value->load();
+  settings.mpe = mpe.value->load() >= 0.5f;
+  settings.mpeBendRange = mpeBendRange.value->load();
+  settings.vibratoRate = vibratoRate.value->load();
+  settings.vibratoDepth = vibratoDepth.value->load();
+  settings.modWheelDepth = modWheelDepth.value->load();
+  settings.portamentoTime = portamentoTime.value->load();
+}
+
+void PatchParameters::set(const Parameter &parameter, float value) {
+  parameter.parameter->setValueNotifyingHost(
+      parameter.parameter->convertTo0to1(value));
+}
+
+void PatchParameters::load(const PatchConsts &patch) {
+  for (int op = 0; op < 4; op++) {
+    for (int index = 0; index < numOpParameters; index++) {
+      set(opParameters[op * numOpParameters + index],
+          getOpValue(patch, op, index));
+    }
+  }
+  set(decayScaling, patch.DTE1Scaling);
+}
+
+void PatchParameters::load(const PerformanceSettings &settings) {
+  set(bendRange, settings.bendRange);
+  set(mpe, settings.mpe ? 1.0f : 0.0f);
+  set(mpeBendRange, settings.mpeBendRange);
+  set(vibratoRate, settings.vibratoRate);
+  set(vibratoDepth, settings.vibratoDepth);
+  set(modWheelDepth, settings.modWheelDepth);
+  set(portamentoTime, settings.portamentoTime);
+}
+
+void PatchParameters::setFMModes(int ch1Mode, int ch2Mode) {
+  set(modes[0], (float)juce::jlimit(0, 3, ch1Mode));
+  set(modes[1], (float)juce::jlimit(0, 3, ch2Mode));
+}
@@ -0,0 +1,129 @@
+/*
+  ==============================================================================
+
+    Patch data, its host parameters and the snapshot the audio thread plays.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+
+struct PatchConsts {
+  float Ratio[4] = {1, 1, 1, 1};  // C1,C2,M1,M2 Ratios.
+  int Detune[4] = {0, 12, 3, 12}; // C1,C2,M1,M2 detune in cents +-16
+
+  // 44(2key) settings. (First two values in array set upper and lower scaling
+  // to the rest of values.)
+  float C1EC[46] = {0.0, 0.65, 0.9, 0.9, 0.9, 0.9, 0.9, 0.9, 0.9, 0.9, 0.9, 0.9,
+                    0.9, 0.9,  0.9, 1,   1,   1,   1,   1,   1,   1,   1,   1,
+                    1,   1,    1,   1,   1,   1,   1,   1,   1,   1,   1,   1,
+                    0.9, 0.9,  0.8, 0.8, 0.8, 0.8, 0.8, 0.8, 0.8, 0.8};
+  float C2EC[46] = {0.0, 0.35, 0.2, 0.3, 0.3, 0.4, 0.5, 0.5, 0.6, 0.6, 0.7, 0.7,
+                    0.8, 0.8,  0.9, 0.9, 1,   1,   1,   1,   0.9, 0.9, 0.8, 0.7,
+                    0.6, 0.5,  0.4, 0.3, 0.2, 0.2, 0.1, 0.1, 0.1, 0.1, 0.1, 0.1,
+                    0.1, 0.1,  0.1, 0.1, 0.1, 0.1, 0.1, 0.1, 0.1, 0.1};
+  float M1EC[46] = {0.0,  0.7,  0.9,  0.9,  0.6,  0.6, 0.6, 0.6, 0.7, 0.7,
+                    0.7,  0.8,  0.8,  0.9,  0.9,  1,   0.9, 0.8, 0.8, 0.7,
+                    0.7,  0.7,  0.7,  0.6,  0.6,  0.5, 0.5, 0.4, 0.4, 0.3,
+                    0.3,  0.2,  0.2,  0.1,  0.1,  0.1, 0.1, 0.1, 0.1, 0.1,
+                    0.05, 0.05, 0.05, 0.05, 0.05, 0.05};
+  float M2EC[46] = {0.1, 0.55, 0.9, 0.9, 1,   1,    1,    1,   1,   1,
+                    1,   1,    1,   0.9, 0.9, 0.8,  0.8,  0.7, 0.7, 0.7,
+                    0.6, 0.6,  0.6, 0.5, 0.5, 0.5,  0.5,  0.5, 0.5, 0.4,
+                    0.3, 0.2,  0.1, 0.1, 0.1, 0.05, 0.01, 0.0, 0.0, 0.0,
+                    0.0, 0.0,  0.0, 0.0, 0.0, 0.0};
+
+  float ATE[4] = {2000, 2000, 4400, 4400}; // Scaled to key in perc mode
+  float DTE[4] = {2, 2, 1, 1};
+  float RTE[4] = {100, 100, 100, 100};
+  int SL[4] = {0, 0, 0, 0}; // 8bit sustain level
+  float DTE1Scaling = 3;
+};
+
+// True if every field is within the range of its host parameter. Anything
+// else, NaN included, is no patch the engine can play.
+bool isPlayable(const PatchConsts &patch);
+
+// noteOn() values of one patch for one MIDI note.
+struct KeyParams {
+  static constexpr int numNotes = 128;
+
+  int CW[4] = {};   // Phase accumulator control words.
+  float AT[4] = {}; // Envelope rates.
+  float DT[4] = {};
+  float RT[4] = {};
+  int EG[4] = {}; // Key scaling of the operator volume.
+};
+
+// How the player's controllers move the pitch. Not part of the patches,
+// they stay put across program changes.
+struct PerformanceSettings {
+  float bendRange = 2;      // Semitones at full pitch wheel.
+  bool mpe = false;         // Channel 1 is the master of channels 2-16.
+  float mpeBendRange = 48;  // Semitones, per-note wheel of member channels.
+  float vibratoRate = 5.5f; // Hz
+  float vibratoDepth = 0;   // Cents, always on.
+  float modWheelDepth = 50; // Cents added at full mod wheel.
+  float portamentoTime = 0; // Seconds from the previous note, 0 is off.
+};
+
+class PatchBank;
+
+// Everything the audio thread needs from the patches, built on the message
+// thread and handed over whole. The bank is shared, not copied: the snapshot
+// only keeps it mapped while the audio thread may still play from it.
+struct PatchSnapshot {
+  std::shared_ptr<const PatchBank> bank;
+  int program = 0;     // The program the parameters edit,
+  PatchConsts edited;  // and its edited version.
+  int fmModes[2] = {0, 0}; // FM mode CH1 and CH2
+  PerformanceSettings performance;
+
+  // noteOn() values per MIDI note, so a note on does no maths: of every bank
+  // patch at [patch * KeyParams::numNotes + note], built once per bank, and
+  // of the edited program.
+  std::shared_ptr<const std::vector<KeyParams>> bankKeys;
+  KeyParams editedKeys[KeyParams::numNotes];
+};
+
+//==============================================================================
+// Host parameters for the patch being edited: per operator ratio, detune,
+// envelope rates, sustain and the two ends of the level curve, plus the FM
+// routing. Ranges are linear with power-of-two spans, so loading a patch
+// and reading it back gives the same values bit for bit. The performance
+// settings are parameters too, but never loaded from a patch.
+class PatchParameters {
+public:
+  static juce::AudioProcessorValueTreeState::ParameterLayout createLayout();
+
+  explicit PatchParameters(juce::AudioProcessorValueTreeState &state);
+
+  // Overwrites the edited fields of patch with the current values. Lock-free,
+  // any thread.
+  void read(PatchConsts &patch, int *fmModes) const;
+  void read(PerformanceSettings &settings) const;
+
+  // Sets every patch parameter, notifying the host.
+  void load(const PatchConsts &patch);
+  void load(const PerformanceSettings &settings);
+  void setFMModes(int ch1Mode, int ch2Mode);
+
+  const juce::StringArray &getIDs() const { return ids; }
+
+private:
+  struct Parameter {
+    juce::RangedAudioParameter *parameter = nullptr;
+    std::atomic<float> *value = nullptr;
+  };
+
+  void set(const Parameter &parameter, float value);
+
+  juce::StringArray ids;
+  juce::Array<Parameter> opParameters; // [op * numOpParameters + index]
+  Parameter modes[2];
+  Parameter decayScaling;
+  Parameter bendRange, mpe, mpeBendRange, vibratoRate, vibratoDepth,
+      modWheelDepth, portamentoTime;
+};
@@ -0,0 +1,142 @@
+/*
+  ==============================================================================
+
+    Read-only patch banks, memory mapped and shared between instances.
+
+  ==============================================================================
+*/
+
+#include "PatchBank.h"
+
+#include <map>
+#include <mutex>
+
+static_assert(std::is_trivially_copyable<PatchConsts>::value,
+              "bank records are used in place");
+static_assert(sizeof(PatchConsts) % 4 == 0 && alignof(PatchConsts) == 4,
+              "bank records are packed 32-bit fields");
+static_assert(sizeof(PatchBank::Record) ==
+                  PatchBank::nameLength + sizeof(PatchConsts),
+              "bank records have no padding");
+
+static PatchBank::Record makeRecord(const char *name,
+                                    const PatchConsts &patch) {
+  PatchBank::Record record = {};
+  juce::String(name).copyToUTF8(record.name, PatchBank::nameLength);
+  record.patch = patch;
+  return record;
+}
+
+static PatchConsts makeEP22() {
+  PatchConsts patch;
+  float Ratio[] = {1, 7, 1, 15}; // C1,C2,M1,M2 Ratios.
+  int Detune[] = {0, 0, 5, 0};   // C1,C2,M1,M2 detune in cents +-16
+  float C1EC[] = {
+      0.0, 1,   0.5, 0.5, 0.5, 0.5, 0.6, 0.6, 0.7, 0.7, 0.8, 0.8,
+      0.9, 0.9, 0.9, 1,   1,   1,   1,   1,   1,   1,   1,   1,
+      1,   1,   1,   1,   1,   1,   1,   1,   1,   0.9, 0.9, 0.9,
+      0.8, 0.8, 0.7, 0.7, 0.6, 0.6, 0.5, 0.5, 0.4, 0.4}; // First lower and
+                                                         // upper limit(max amp
+                                                         // for velocity) then
+                                                         // 44(2key) settings.
+  float C2EC[] = {0.0, 0.06, 0.6,  0.6,  0.6,  0.6, 0.6, 0.6, 0.7, 0.7,
+                  0.7, 0.7,  0.7,  0.7,  0.6,  0.6, 0.5, 0.5, 0.4, 0.4,
+                  0.4, 0.4,  0.4,  0.4,  0.4,  0.4, 0.4, 0.3, 0.3, 0.3,
+                  0.3, 0.3,  0.2,  0.2,  0.2,  0.2, 0.1, 0.1, 0.1, 0.1,
+                  0.1, 0.05, 0.05, 0.05, 0.05, 0.05};
+  float M1EC[] = {0.0,  0.27, 1,    1,    1,    1,    1,    1,    0.9,  0.9,
+                  0.8,  0.8,  0.7,  0.7,  0.6,  0.6,  0.6,  0.6,  0.6,  0.6,
+                  0.6,  0.5,  0.5,  0.5,  0.4,  0.4,  0.3,  0.3,  0.3,  0.2,
+                  0.2,  0.1,  0.1,  0.1,  0.05, 0.05, 0.05, 0.01, 0.01, 0.01,
+                  0.01, 0.01, 0.01, 0.01, 0.01, 0.01};
+  float M2EC[] = {0.0, 0.3, 1,   1,   1,   1,   1,   0.9,  0.9, 0.8, 0.8, 0.7,
+                  0.7, 0.6, 0.5, 0.4, 0.3, 0.2, 0.1, 0.05, 0.0, 0.0, 0.0, 0.0,
+                  0,   0,   0,   0,   0,   0,   0,   0,    0,   0,   0,   0,
+                  0,   0,   0,   0,   0,   0,   0,   0,    0,   0};
+  float ATE[] = {2000, 2000, 1800, 3000};
+  memcpy(patch.Ratio, Ratio, sizeof(Ratio));
+  memcpy(patch.Detune, Detune, sizeof(Detune));
+  memcpy(patch.C1EC, C1EC, sizeof(C1EC));
+  memcpy(patch.C2EC, C2EC, sizeof(C2EC));
+  memcpy(patch.M1EC, M1EC, sizeof(M1EC));
+  memcpy(patch.M2EC, M2EC, sizeof(M2EC));
+  memcpy(patch.ATE, ATE, sizeof(ATE));
+  patch.DTE1Scaling = 15;
+  return patch;
+}
+
+std::shared_ptr<const PatchBank> PatchBank::getFactory() {
+  static const Record factoryRecords[] = {makeRecord("EP11", PatchConsts()),
+                                          makeRecord("EP22", makeEP22())};
+  static const std::shared_ptr<const PatchBank> factory = [] {
+    std::shared_ptr<PatchBank> bank(new PatchBank());
+    bank->records = factoryRecords;
+    bank->numPatches = (int)std::size(factoryRecords);
+    return bank;
+  }();
+  return factory;
+}
+
+std::shared_ptr<const PatchBank> PatchBank::open(const juce::File &file) {
+  static std::mutex openLock;
+  static std::map<juce::String, std::weak_ptr<const PatchBank>> openBanks;
+
+  const std::lock_guard<std::mutex> lock(openLock);
+  const auto path = file.getFullPathName();
+  if (auto bank = openBanks[path].lock()) {
+    return bank;
+  }
+
+#if JUCE_BIG_ENDIAN
+  return nullptr;
+#else
+  auto mapping = std::make_unique<juce::MemoryMappedFile>(
+      file, juce::MemoryMappedFile::readOnly, false);
+  const auto size = (size_t)mapping->getSize();
+  const auto *data = static_cast<const char *>(mapping->getData());
+  if (data == nullptr || size < sizeof(Header)) {
+    return nullptr;
+  }
+
+  const auto *header = reinterpret_cast<const Header *>(data);
+  if (header->magic != magic || header->version != version ||
+      header->recordSize != sizeof(Record) ||
+      header->numPatches == 0 || header->numPatches > 1000000 ||
+      size < sizeof(Header) + header->numPatches * sizeof(Record)) {
+    return nullptr;
+  }
+
+  // Used in place, so checked once here rather than on every note on.
+  const auto *records = reinterpret_cast<const Record *>(data + sizeof(Header));
+  for (uint32_t i = 0; i < header->numPatches; i++) {
+    if (!isPlayable(records[i].patch)) {
+      return nullptr;
+    }
+  }
+
+  std::shared_ptr<PatchBank> bank(new PatchBank());
+  bank->records = records;
+  bank->numPatches = (int)header->numPatches;
+  bank->file = file;
+  bank->mapping = std::move(mapping);
+  openBanks[path] = bank;
+  return bank;
+#endif
+}
+
+bool PatchBank::write(const juce::File &file, const PatchBank &bank) {
+  file.deleteFile();
+  juce::FileOutputStream stream(file);
+  if (!stream.openedOk()) {
+    return false;
+  }
+  const Header header = {magic, version, (uint32_t)bank.numPatches,
+                         (uint32_t)sizeof(Record)};
+  return stream.write(&header, sizeof(header)) &&
+         stream.write(bank.records, sizeof(Record) * bank.numPatches);
+}
+
+juce::String PatchBank::getName(int index) const {
+  return juce::String::fromUTF8(records[index].name,
+                                (int)strnlen(records[index].name, nameLength));
+}
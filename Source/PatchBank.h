@@ -0,0 +1,59 @@
+/*
+  ==============================================================================
+
+    Read-only patch banks, memory mapped and shared between instances.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include "Patch.h"
+#include <memory>
+
+// GS1B bank file: a Header followed by numPatches Records. Every field is a
+// 32-bit little endian int or float and a record is PatchConsts as laid out
+// in memory, so a mapped file is used in place: no parsing, no copies.
+class PatchBank {
+public:
+  static constexpr uint32_t magic = 0x42315347; // "GS1B"
+  static constexpr uint32_t version = 1;
+  static constexpr int nameLength = 32;
+
+  struct Header {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t numPatches;
+    uint32_t recordSize; // sizeof(Record), catches layout changes.
+  };
+
+  struct Record {
+    char name[nameLength]; // UTF-8, zero padded.
+    PatchConsts patch;
+  };
+
+  // EP11 and EP22, from static memory.
+  static std::shared_ptr<const PatchBank> getFactory();
+
+  // Maps a bank file read-only. Opening a file that is already open in this
+  // process returns the same bank. nullptr if the file is not a valid bank,
+  // or if any of its patches is not isPlayable().
+  static std::shared_ptr<const PatchBank> open(const juce::File &file);
+
+  static bool write(const juce::File &file, const PatchBank &bank);
+
+  int getNumPatches() const { return numPatches; }
+  const PatchConsts &getPatch(int index) const { return records[index].patch; }
+  juce::String getName(int index) const;
+
+  // Empty for the factory bank.
+  const juce::File &getFile() const { return file; }
+
+private:
+  PatchBank() = default;
+
+  std::unique_ptr<juce::MemoryMappedFile> mapping;
+  const Record *records = nullptr;
+  int numPatches = 0;
+  juce::File file;
+};
@@ -9,14 +9,135 @@
 #include "PluginEditor.h"
 #include "PluginProcessor.h"
 
+static const juce::Colour backgroundColour(0xff1b1d21);
+static const juce::Colour panelColour(0xff0f1013);
+static const juce::Colour gridColour(0xff2c3038);
+static const juce::Colour scopeColour(0xff7fd1ae);
+static const juce::Colour textColour(0xffb8bec9);
+
+// Meter colour per VoiceAllocator list.
+static juce::Colour getVoiceColour(int list) {
+  switch (list) {
+  case VoiceAllocator::heldList:
+    return juce::Colour(0xff7fd1ae);
+  case VoiceAllocator::releasingList:
+    return juce::Colour(0xffd19a5f);
+  default: // Sustained.
+    return juce::Colour(0xffd1c85f);
+  }
+}
 
 //==============================================================================
 GS1_juceAudioProcessorEditor::GS1_juceAudioProcessorEditor(
     GS1_juceAudioProcessor &p)
     : AudioProcessorEditor(&p), audioProcessor(p) {
-  setSize(100, 100);
+  setOpaque(true);
+  setSize(520, 300);
+  audioProcessor.display.attachReader(true);
+  startTimerHz(refreshRate);
+}
+
+GS1_juceAudioProcessorEditor::~GS1_juceAudioProcessorEditor() {
+  stopTimer();
+  audioProcessor.display.attachReader(false);
+}
+
+void GS1_juceAudioProcessorEditor::resized() {
+  auto area = getLocalBounds().reduced(10);
+  cpuArea = area.removeFromBottom(20);
+  scopeArea = area.removeFromTop(area.getHeight() * 3 / 5);
+  area.removeFromTop(10);
+  voiceArea = area;
+
+  scope.assign((size_t)juce::jmax(1, scopeArea.getWidth()), ScopePoint());
+  scopeEnd = 0;
+  drawBackground();
+}
+
+void GS1_juceAudioProcessorEditor::drawBackground() {
+  background = juce::Image(juce::Image::RGB, juce::jmax(1, getWidth()),
+                           juce::jmax(1, getHeight()), false);
+  juce::Graphics g(background);
+  g.fillAll(backgroundColour);
+  g.setColour(panelColour);
+  g.fillRect(scopeArea);
+  g.fillRect(voiceArea);
+
+  // Zero and half scale.
+  g.setColour(gridColour);
+  const float halfHeight = scopeArea.getHeight() * 0.5f;
+  for (float level : {-0.5f, 0.0f, 0.5f}) {
+    const int y = scopeArea.getCentreY() - juce::roundToInt(level * halfHeight);
+    g.drawHorizontalLine(y, (float)scopeArea.getX(),
+                         (float)scopeArea.getRight());
+  }
+  // A line every 8 voices, or every multiple of 8 when there are many.
+  const int numBars = juce::jmax(1, voiceFrame.numVoices);
+  const float barWidth = voiceArea.getWidth() / (float)numBars;
+  const int gridStep = juce::jmax(8, (numBars + 63) / 64 * 8);
+  for (int v = gridStep; v < numBars; v += gridStep) {
+    g.drawVerticalLine(voiceArea.getX() + juce::roundToInt(v * barWidth),
+                       (float)voiceArea.getY(), (float)voiceArea.getBottom());
+  }
+}
+
+//==============================================================================
+void GS1_juceAudioProcessorEditor::timerCallback() {
+  auto &display = audioProcessor.display;
+  bool changed = false;
+  const int size = (int)scope.size();
+  const int maxPoints = (int)std::size(incoming);
+  for (int count; (count = display.readScope(incoming, maxPoints)) > 0;) {
+    for (int i = 0; i < count; i++) {
+      scope[(size_t)scopeEnd] = incoming[i];
+      scopeEnd = (scopeEnd + 1) % size;
+    }
+    changed = true;
+  }
+  const int numBars = voiceFrame.numVoices;
+  changed |= display.readVoices(voiceFrame);
+  if (voiceFrame.numVoices != numBars) {
+    drawBackground(); // The polyphony changed.
+  }
+  if (changed) {
+    repaint();
+  }
 }
 
-GS1_juceAudioProcessorEditor::~GS1_juceAudioProcessorEditor() {}
+void GS1_juceAudioProcessorEditor::paint(juce::Graphics &g) {
+  g.drawImageAt(background, 0, 0);
+
+  // Oldest point on the left, one column each.
+  g.setColour(scopeColour);
+  const float centre = (float)scopeArea.getCentreY();
+  const float halfHeight = scopeArea.getHeight() * 0.5f;
+  const int size = (int)scope.size();
+  for (int x = 0; x < size; x++) {
+    const auto &point = scope[(size_t)((scopeEnd + x) % size)];
+    const float top =
+        centre - juce::jlimit(-1.0f, 1.0f, point.max) * halfHeight;
+    const float bottom =
+        centre - juce::jlimit(-1.0f, 1.0f, point.min) * halfHeight;
+    g.drawVerticalLine(scopeArea.getX() + x, top, bottom + 1.0f);
+  }
 
-void GS1_juceAudioProcessorEditor::resized() {}
+  const float barWidth =
+      voiceArea.getWidth() / (float)juce::jmax(1, voiceFrame.numVoices);
+  const float gap = barWidth > 4.0f ? 1.0f : 0.0f; // Dense bars touch.
+  for (int v = 0; v < voiceFrame.numVoices; v++) {
+    const int list = voiceFrame.lists[v];
+    if (list == VoiceAllocator::freeList) {
+      continue;
+    }
+    const float height = voiceFrame.levels[v] * voiceArea.getHeight();
+    g.setColour(getVoiceColour(list));
+    g.fillRect(voiceArea.getX() + v * barWidth + gap,
+               voiceArea.getBottom() - height, barWidth - 2.0f * gap, height);
+  }
+
+  g.setColour(textColour);
+  g.setFont(13.0f);
+  g.drawText("CPU " + juce::String(voiceFrame.cpuLoad * 100.0f, 1) +
+                 "%   voices " + juce::String(voiceFrame.numActive),
+             cpuArea, juce::Justification::centredLeft);
+}
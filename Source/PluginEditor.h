@@ -13,18 +13,35 @@
 
 
 //==============================================================================
-/**
- */
-class GS1_juceAudioProcessorEditor : public juce::AudioProcessorEditor {
+// Oscilloscope of the main output, a meter per voice and the CPU load. Fed
+// only through the processor's DisplayFeed, polled at refreshRate; repaints
+// only when something new arrived, over a cached background.
+class GS1_juceAudioProcessorEditor : public juce::AudioProcessorEditor,
+                                     private juce::Timer {
 public:
   GS1_juceAudioProcessorEditor(GS1_juceAudioProcessor &);
   ~GS1_juceAudioProcessorEditor() override;
 
+  static constexpr int refreshRate = 30;
+
   //==============================================================================
+  void paint(juce::Graphics &g) override;
   void resized() override;
 
 private:
+  void timerCallback() override;
+  void drawBackground();
+
   GS1_juceAudioProcessor &audioProcessor;
 
+  juce::Rectangle<int> scopeArea, voiceArea, cpuArea;
+  juce::Image background; // Panels and grid, redrawn on resize.
+
+  // One point per scope pixel column, a ring ending at scopeEnd.
+  std::vector<ScopePoint> scope;
+  int scopeEnd = 0;
+  ScopePoint incoming[2048];
+  VoiceFrame voiceFrame;
+
   JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(GS1_juceAudioProcessorEditor)
 };
@@ -8,151 +8,101 @@
 
 #include "PluginProcessor.h"
 #include "PluginEditor.h"
+#include "Tables.h"
 
 // Constants
-static int SampleRate = 34687; // 34687Hz Samplerate (IMPORTANT!)
-// Note! Sinewave phase resolution has to be 10bit for quantization error to
-// give right sound!
-
-static int DTE[] = {2, 2, 1, 1};
-static int RTE[] = {100, 100, 100, 100};
-static int IL[] = {0, 0, 0, 0};
-static int SL[] = {0, 0, 0, 0}; // 8bit sustain level
-static int FMmode[] = {0, 0};   // FM mode CH1 and CH2
-
-static double PI = 3.1415927;
-static double HALF_PI = 1.5707964;
-
-// Tables
-static int Sin[4096];
-static int logsinTable[256];
-static int expTable[256];
-static int expTable2[4096];
+static constexpr int SampleRate = 34687; // 34687Hz Samplerate (IMPORTANT!)
 
 static double map(double x, double in_min, double in_max, double out_min,
                   double out_max) {
   return (x - in_min) * (out_max - out_min) / (in_max - in_min) + out_min;
 }
 
-static int lookupSin(int val) {
-  bool signsin = (bool)(val & 512);
-  bool mirrorsin = (bool)(val & 256);
-  val &= 255;
-  int result = logsinTable[mirrorsin ? val ^ 255 : val ^ 0];
-  if (signsin) {
-    result |= 0x8000;
+// noteOn() values of a patch for a MIDI note. A few pow() each, so they are
+// computed off the audio thread into the patch snapshot.
+static KeyParams computeKeyParams(const PatchConsts &patch, int note) {
+  KeyParams key;
+  const float KNOTE = note - 24 - 1; // noteOn() key, FROM A1
+
+  // Calculate phase accumulator control words. High ratios on the top keys
+  // would overflow an int: capped so the 28 bit phase plus the word fits.
+  for (int i = 0; i < 4; i++) {
+    key.CW[i] = int(juce::jmin(
+        pow(2, 28) /
+            (SampleRate / (27.50 *
+                           pow(2, (KNOTE + (patch.Detune[i] * 0.01)) / (12)) *
+                           patch.Ratio[i])),
+        double(1 << 30)));
+  }
+
+  // in perc mode recalc envelope times depending on note.
+  for (int i = 0; i < 4; i++) {
+    key.AT[i] = patch.ATE[i] * map((KNOTE + 1), 1, 88, 1, 4);
+    key.DT[i] = patch.DTE[i] * map((KNOTE + 1), 1, 88, 0.5,
+                                   i == 1 ? patch.DTE1Scaling : 3);
+    key.RT[i] = patch.RTE[i] * map((KNOTE + 1), 1, 88, 1, 2);
   }
-  return result;
+
+  // calc operator volume scaler depending on note index in scaler array.
+  // Keys outside the 44 scaler entries use the nearest one.
+  const int scaler = juce::jlimit(2, 45, int(floor(KNOTE / 2) + 2));
+  const float *EC[4] = {patch.C1EC, patch.C2EC, patch.M1EC, patch.M2EC};
+  for (int i = 0; i < 4; i++) {
+    key.EG[i] = floor(map(pow(map(1, 0, 1, EC[i][0],
+                                  map(EC[i][scaler], 0, 1, EC[i][0],
+                                      EC[i][1])),
+                              0.1),
+                          0, 1, 1, 0) *
+                      4095);
+  }
+  return key;
 }
 
-static int lookupExp(int val) {
-  bool signexp = (bool)(val & 0x8000);
-  int t = (expTable[(val & 255) ^ 255] | (32768)) << 1;
-  int result = t >> ((val & 0x7F00) >> 8);
-  if (signexp) {
-    result = -result - 1;
+static void computeKeyParams(const PatchConsts &patch, KeyParams *keys) {
+  for (int note = 0; note < KeyParams::numNotes; note++) {
+    keys[note] = computeKeyParams(patch, note);
   }
-  return result >> 4;
 }
 
-void GS1_juceAudioProcessor::noteOn(VoiceState &voiceState, float KNOTE,
-                                    float Velocity) {
-  PatchConsts patch = patches[currentPatch];
+// Slowest carrier release of a patch: from full level, on the lowest key.
+static double getReleaseSeconds(const KeyParams &key) {
+  return juce::jmax(OperatorEnvelopes::getStageSamples(key.RT[0]),
+                    OperatorEnvelopes::getStageSamples(key.RT[1])) /
+         (double)SampleRate;
+}
+
+// Voice sums to the -1..1 mix. No voices is exactly 0.
+static float toMixSample(int32_t sum) {
+  return float(sum * (2.0 / (262112 / 6 - -262144 / 6)));
+}
 
+// noteOn() for given patch data and its values for the key, also used to
+// render the note cache.
+static void startVoice(VoiceState &voiceState, const PatchConsts &patchData,
+                       const KeyParams &key, int patch, float KNOTE,
+                       float Velocity) {
   voiceState.noteOn = true;
   voiceState.midiNote = KNOTE;
 
-  voiceState.KNOTE = KNOTE;
+  voiceState.patch = patch;
+  voiceState.KNOTE = KNOTE - 1;
   voiceState.Velocity = Velocity;
-  for (int i = 0; i < 4; i++) {
-    voiceState.STATE[i] = 0;
-    voiceState.EA[i] = 0;  // 16bit
-    voiceState.EAx[i] = 0; // 16bit
-    voiceState.EAo[i] = 0; // oldaccu
-    voiceState.RS[i] = 0;
-    voiceState.RSx[i] = 0;
-    voiceState.GATE = 0;
-    voiceState.GATEOLD = 0;
-    voiceState.Mode = 0;
-  }
   for (int i = 0; i < 4; i++) {
     voiceState.PAI[i] = 0;
     voiceState.PAE[i] = 0;
+    voiceState.CW[i] = key.CW[i];
+    voiceState.keyCW[i] = key.CW[i];
+    voiceState.targetCW[i] = key.CW[i];
+    voiceState.AT[i] = key.AT[i];
+    voiceState.DT[i] = key.DT[i];
+    voiceState.RT[i] = key.RT[i];
   }
-  voiceState.KNOTE = voiceState.KNOTE - 1;
-  voiceState.NOTE = 27.50 * pow(2, (voiceState.KNOTE / (12))); // FROM A1
-  voiceState.rnd = 0;
-
-  // Calculate phase accumulator control words.
-  voiceState.CW[0] = int(
-      pow(2, 28) / (SampleRate / (27.50 *
-                                  pow(2, (voiceState.KNOTE + voiceState.rnd +
-                                          (patch.Detune[0] * 0.01)) /
-                                             (12)) *
-                                  patch.Ratio[0])));
-  voiceState.CW[1] = int(
-      pow(2, 28) / (SampleRate / (27.50 *
-                                  pow(2, (voiceState.KNOTE + voiceState.rnd +
-                                          (patch.Detune[1] * 0.01)) /
-                                             (12)) *
-                                  patch.Ratio[1])));
-  voiceState.CW[2] = int(
-      pow(2, 28) / (SampleRate / (27.50 *
-                                  pow(2, (voiceState.KNOTE + voiceState.rnd +
-                                          (patch.Detune[2] * 0.01)) /
-                                             (12)) *
-                                  patch.Ratio[2])));
-  voiceState.CW[3] = int(
-      pow(2, 28) / (SampleRate / (27.50 *
-                                  pow(2, (voiceState.KNOTE + voiceState.rnd +
-                                          (patch.Detune[3] * 0.01)) /
-                                             (12)) *
-                                  patch.Ratio[3])));
-
-  // in perc mode recalc envelope times depending on note.
-  voiceState.AT[0] = patch.ATE[0] * map((voiceState.KNOTE + 1), 1, 88, 1, 4);
-  voiceState.AT[1] = patch.ATE[1] * map((voiceState.KNOTE + 1), 1, 88, 1, 4);
-  voiceState.AT[2] = patch.ATE[2] * map((voiceState.KNOTE + 1), 1, 88, 1, 4);
-  voiceState.AT[3] = patch.ATE[3] * map((voiceState.KNOTE + 1), 1, 88, 1, 4);
-  voiceState.DT[0] = DTE[0] * map((voiceState.KNOTE + 1), 1, 88, 0.5, 3);
-  voiceState.DT[1] =
-      DTE[1] * map((voiceState.KNOTE + 1), 1, 88, 0.5, patch.DTE1Scaling);
-  voiceState.DT[2] = DTE[2] * map((voiceState.KNOTE + 1), 1, 88, 0.5, 3);
-  voiceState.DT[3] = DTE[3] * map((voiceState.KNOTE + 1), 1, 88, 0.5, 3);
-  voiceState.RT[0] = RTE[0] * map((voiceState.KNOTE + 1), 1, 88, 1, 2);
-  voiceState.RT[1] = RTE[1] * map((voiceState.KNOTE + 1), 1, 88, 1, 2);
-  voiceState.RT[2] = RTE[2] * map((voiceState.KNOTE + 1), 1, 88, 1, 2);
-  voiceState.RT[3] = RTE[3] * map((voiceState.KNOTE + 1), 1, 88, 1, 2);
-
-  // calc operator volume scaler depending on note index in scaler array.
-  voiceState.EG2 =
-      floor(map(pow(map(1, 0, 1, patch.M1EC[0],
-                        map(patch.M1EC[int(floor(voiceState.KNOTE / 2) + 2)], 0,
-                            1, patch.M1EC[0], patch.M1EC[1])),
-                    0.1),
-                0, 1, 1, 0) *
-            4095);
-  voiceState.EG1 =
-      floor(map(pow(map(1, 0, 1, patch.C2EC[0],
-                        map(patch.C2EC[int(floor(voiceState.KNOTE / 2) + 2)], 0,
-                            1, patch.C2EC[0], patch.C2EC[1])),
-                    0.1),
-                0, 1, 1, 0) *
-            4095);
-  voiceState.EG3 =
-      floor(map(pow(map(1, 0, 1, patch.M2EC[0],
-                        map(patch.M2EC[int(floor(voiceState.KNOTE / 2) + 2)], 0,
-                            1, patch.M2EC[0], patch.M2EC[1])),
-                    0.1),
-                0, 1, 1, 0) *
-            4095);
-  voiceState.EG0 =
-      floor(map(pow(map(1, 0, 1, patch.C1EC[0],
-                        map(patch.C1EC[int(floor(voiceState.KNOTE / 2) + 2)], 0,
-                            1, patch.C1EC[0], patch.C1EC[1])),
-                    0.1),
-                0, 1, 1, 0) *
-            4095);
+  voiceState.pitch = 0;
+  voiceState.portamento = 0;
+  voiceState.EG0 = key.EG[0];
+  voiceState.EG1 = key.EG[1];
+  voiceState.EG2 = key.EG[2];
+  voiceState.EG3 = key.EG[3];
 
   voiceState.CH1 = 0;
   voiceState.CH2 = 0;
@@ -163,88 +113,25 @@ void GS1_juceAudioProcessor::noteOn(VoiceState &voiceState, float KNOTE,
   voiceState.M2old1 = 0;
   voiceState.M2old2 = 0;
 
-  voiceState.GATENEW = 1;
+  // Operator volume is calculated from scaled volume and velocity.
+  const int baseAmp[4] = {4095 + voiceState.EG0 + (int(Velocity) << 3),
+                          4095 + voiceState.EG1 + (int(Velocity) << 3),
+                          4095 + voiceState.EG2 + (int(Velocity) << 3),
+                          4095 + voiceState.EG3 + (int(Velocity) << 3)};
+  int sustain[4];
+  for (int i = 0; i < 4; i++) {
+    sustain[i] = patchData.SL[i] << 12;
+  }
+  voiceState.envelopes.start(voiceState.AT, voiceState.DT, voiceState.RT,
+                             sustain, baseAmp);
+  voiceState.GATE = 1;
+  voiceState.cached = nullptr;
 }
 
-int GS1_juceAudioProcessor::fmGenSample(VoiceState &voiceState) {
-  for (int e = 0; e < 4; e++) {
-    if (voiceState.Mode == 0) {
-      if (voiceState.GATEOLD == 0 && voiceState.GATE == 1) {
-        voiceState.STATE[e] = 1;
-        voiceState.EA[e] = IL[e] << 12;
-      }
-      if (voiceState.GATE == 1 && voiceState.STATE[e] == 1 &&
-          voiceState.EA[e] < 0xFFFFF) {
-        voiceState.EA[e] = voiceState.EA[e] + voiceState.AT[e];
-        voiceState.EAx[e] = voiceState.EA[e];
-        if (voiceState.EA[e] > 0xFFFFF) {
-          voiceState.EA[e] = 0xFFFFF;
-        }
-      }
-      if (voiceState.GATE == 1 && voiceState.STATE[e] == 1 &&
-          voiceState.EA[e] >= 0xFFFFF) {
-        voiceState.STATE[e] = 2;
-      }
-      if (voiceState.GATE == 1 && voiceState.STATE[e] == 2 &&
-          voiceState.EA[e] > SL[e] << 12) {
-        voiceState.EA[e] = voiceState.EA[e] - voiceState.DT[e];
-        if (voiceState.EA[e] < SL[e] << 12) {
-          voiceState.EA[e] = SL[e] << 12;
-        }
-        voiceState.EAx[e] =
-            int(map(expTable2[int(
-                        map(voiceState.EA[e], SL[e] << 12, 0xFFFFF, 0, 4095))],
-                    0, 4095, SL[e] << 12, 0xFFFFF));
-      }
-      if (voiceState.GATE == 0 && voiceState.GATEOLD == 1) {
-        voiceState.RS[e] = voiceState.EA[e];
-        voiceState.RSx[e] = voiceState.EAx[e];
-        voiceState.RT[e] = voiceState.RT[e];
-      }
-      if (voiceState.GATE == 0 && voiceState.EA[e] > 0) {
-        voiceState.EA[e] = voiceState.EA[e] - voiceState.RT[e];
-        voiceState.STATE[e] = 0;
-        if (voiceState.EA[e] <= 0) {
-          voiceState.EA[e] = 0;
-        }
-        voiceState.EAx[e] =
-            int(map(expTable2[int(map(voiceState.EA[e], 0,
-                                      floor(voiceState.RS[e]), 0, 4095))],
-                    0, 4095, 0, voiceState.RSx[e]));
-      }
-      if (voiceState.GATE == 0 &&
-          voiceState.EAo[e] < (int(voiceState.EA[e]) & 0xFFFFF)) {
-        voiceState.EA[e] = 0;
-      }
-      voiceState.EAo[e] = voiceState.EA[e];
-    }
-  }
-  voiceState.GATEOLD = voiceState.GATE;
-  voiceState.GATE = voiceState.GATENEW;
+// fmGenSample() with a given FM routing.
+static int renderVoiceSample(VoiceState &voiceState, FMSampleFn sampleFn) {
+  voiceState.envelopes.render(voiceState.GATE != 0, 1, voiceState.AMP, 1, 1);
 
-  // Operator volume is calculated from scaled volume and velocity.
-  voiceState.AMP[2] = ((((((int)floor(voiceState.EAx[2]) >> 8) ^ 4095) & 4095) +
-                        int(voiceState.EG2))
-                       << 0) +
-                      (int(voiceState.Velocity) << 3);
-  voiceState.AMP[1] = ((((((int)floor(voiceState.EAx[1]) >> 8) ^ 4095) & 4095) +
-                        int(voiceState.EG1))
-                       << 0) +
-                      (int(voiceState.Velocity) << 3);
-  voiceState.AMP[3] = ((((((int)floor(voiceState.EAx[3]) >> 8) ^ 4095) & 4095) +
-                        int(voiceState.EG3))
-                       << 0) +
-                      (int(voiceState.Velocity) << 3);
-  voiceState.AMP[0] = ((((((int)floor(voiceState.EAx[0]) >> 8) ^ 4095) & 4095) +
-                        int(voiceState.EG0))
-                       << 0) +
-                      (int(voiceState.Velocity) << 3);
-  for (int check = 0; check < 4;
-       check++) { // Make sure amplitude does not go out of range.
-    if (voiceState.AMP[check] >= 4095) {
-      voiceState.AMP[check] = 4095;
-    }
-  }
   // Update all Phase accumulators..(28bit)
   for (int n = 0; n < 4; n++) {
     voiceState.PAI[n] = voiceState.PAI[n] & 0xFFFFFFF;
@@ -253,241 +140,399 @@ int GS1_juceAudioProcessor::fmGenSample(VoiceState &voiceState) {
     voiceState.PAI[n] = voiceState.PAI[n] + voiceState.CW[n];
   }
 
-  // Following section is routing and operator stack config. 4 modes: norm,
-  // pi/2: half intensity modulator self feedback, pi full mod self feedback and
-  // cross from other stack. CHANNEL1
-  if (FMmode[0] == 0) { // NORM
-    if (voiceState.AMP[2] <= 4094) {
-      voiceState.M1 =
-          ((lookupExp(lookupSin(voiceState.PAE[2]) + voiceState.AMP[2]) +
-            8192) >>
-           2) &
-          1023;
-    } else {
-      voiceState.M1 = 4095;
-    }
-    if (voiceState.AMP[0] <= 4094) {
-      voiceState.CH1 =
-          ((lookupExp(lookupSin(voiceState.PAE[0] + voiceState.M1) +
-                      voiceState.AMP[0]))); // 14bit output signed+-
-    } else {
-      voiceState.CH1 = 0;
-    }
-  }
-  if (FMmode[0] == 1) { // PI/2
-    if (voiceState.AMP[2] <= 4094) {
-      voiceState.M1 =
-          (lookupExp(
-               lookupSin(voiceState.PAE[2] +
-                         (((voiceState.M1old1 + voiceState.M1old2) / 2) >> 3)) +
-               voiceState.AMP[2]) +
-           8192) >>
-          4;
-    } else {
-      voiceState.M1 = 4095;
-    }
-    voiceState.M1old2 = voiceState.M1old1;
-    voiceState.M1old1 = voiceState.M1;
-    if (voiceState.AMP[0] <= 4094) {
-      voiceState.CH1 =
-          ((lookupExp(lookupSin(voiceState.PAE[0] + voiceState.M1) +
-                      voiceState.AMP[0]))); // 14bit output signed+-
-    } else {
-      voiceState.CH1 = 0;
-    }
-  }
-  if (FMmode[0] == 2) { // PI
-    if (voiceState.AMP[2] <= 4094) {
-      voiceState.M1 =
-          (lookupExp(
-               lookupSin(voiceState.PAE[2] +
-                         (((voiceState.M1old1 + voiceState.M1old2) / 2) >> 2)) +
-               voiceState.AMP[2]) +
-           8192) >>
-          4;
-    } else {
-      voiceState.M1 = 4095;
-    }
-    voiceState.M1old2 = voiceState.M1old1;
-    voiceState.M1old1 = voiceState.M1;
-    if (voiceState.AMP[0] <= 4094) {
-      voiceState.CH1 =
-          ((lookupExp(lookupSin(voiceState.PAE[0] + voiceState.M1) +
-                      voiceState.AMP[0]))); // 14bit output signed+-
-    } else {
-      voiceState.CH1 = 0;
+  // Routing and operator stack config, shared with the block kernels.
+  return sampleFn(voiceState.PAE, voiceState.AMP, voiceState.M1,
+                  voiceState.M2, voiceState.M1old1, voiceState.M1old2,
+                  voiceState.M2old1, voiceState.M2old2);
+}
+
+void GS1_juceAudioProcessor::noteOn(VoiceState &voiceState, int patch,
+                                    float KNOTE, float Velocity) {
+  startVoice(voiceState, getPatchData(patch),
+             getKeyParams(patch, int(KNOTE) + 24), patch, KNOTE, Velocity);
+}
+
+int GS1_juceAudioProcessor::fmGenSample(VoiceState &voiceState) {
+  return renderVoiceSample(voiceState, getFMSampleFn(fmModes[0], fmModes[1]));
+}
+
+static FMKernelIsa getBestKernelIsa() {
+#if JUCE_INTEL
+  if (juce::SystemStats::hasAVX512F()) {
+    return FMKernelIsa::avx512;
+  }
+  if (juce::SystemStats::hasAVX2()) {
+    return FMKernelIsa::avx2;
+  }
+  if (juce::SystemStats::hasSSE41()) {
+    return FMKernelIsa::sse41;
+  }
+#endif
+  return FMKernelIsa::scalar;
+}
+
+// Main stereo output plus an optional one per part, off by default.
+static juce::AudioProcessor::BusesProperties makeBusesProperties() {
+  auto buses = juce::AudioProcessor::BusesProperties()
+                   .withInput("Input", juce::AudioChannelSet::stereo(), true)
+                   .withOutput("Output", juce::AudioChannelSet::stereo(), true);
+  for (int p = 0; p < GS1_juceAudioProcessor::numParts; p++) {
+    buses = buses.withOutput("Part " + juce::String(p + 1),
+                             juce::AudioChannelSet::stereo(), false);
+  }
+  return buses;
+}
+
+//==============================================================================
+GS1_juceAudioProcessor::GS1_juceAudioProcessor()
+    : AudioProcessor(makeBusesProperties()),
+      parameters(*this, nullptr, "GS1", PatchParameters::createLayout()),
+      patchParameters(parameters) {
+  useBank(PatchBank::getFactory());
+  for (auto &patch : pendingPatches) {
+    patch = -1;
+  }
+  for (auto &limit : partVoiceLimits) {
+    limit = Part().maxVoices;
+  }
+  for (auto &patch : partPatches) {
+    patch = 0;
+  }
+
+  for (const auto &id : patchParameters.getIDs()) {
+    parameters.addParameterListener(id, this);
+  }
+  publishPatch();
+  patchSnapshots.acquire();
+  applyPatch();
+  startTimer(20);
+
+  setKernelIsa(getBestKernelIsa());
+  setRenderThreads(0);
+
+  allocateVoices(defaultPolyphony);
+}
+
+GS1_juceAudioProcessor::~GS1_juceAudioProcessor() {
+  stopTimer();
+  for (const auto &id : patchParameters.getIDs()) {
+    parameters.removeParameterListener(id, this);
+  }
+}
+
+//==============================================================================
+void GS1_juceAudioProcessor::publishPatch() {
+  const juce::ScopedLock lock(publishLock);
+  patchEdited = false;
+
+  // Drops the bank this slot held two publishes ago, here rather than on the
+  // audio thread.
+  PatchSnapshot &next = patchSnapshots.getWriteBuffer();
+  next.bank = bank;
+  next.program = currentProgram;
+  next.edited = bank->getPatch(next.program);
+  patchParameters.read(next.edited, next.fmModes);
+  patchParameters.read(next.performance);
+  next.bankKeys = bankKeys;
+  computeKeyParams(next.edited, next.editedKeys);
+  const double editedReleaseSeconds = getReleaseSeconds(next.editedKeys[0]);
+  patchSnapshots.publish();
+
+  // Release, then the chorus taps and the resampler filter run out.
+  tailSeconds = juce::jmax(bankReleaseSeconds, editedReleaseSeconds) +
+                Chorus::getMaxDelaySeconds() +
+                Resampler::numTaps / (double)SampleRate;
+}
+
+// May come from the audio thread when the host automates, so only flag it.
+void GS1_juceAudioProcessor::parameterChanged(const juce::String &, float) {
+  patchEdited = true;
+}
+
+void GS1_juceAudioProcessor::timerCallback() {
+  if (patchEdited) {
+    publishPatch();
+  }
+}
+
+// Audio thread, after a new snapshot was acquired. Sounding voices of the
+// edited program glide to its new pitch.
+void GS1_juceAudioProcessor::applyPatch() {
+  const PatchBank *previousBank =
+      snapshot != nullptr ? snapshot->bank.get() : nullptr;
+  snapshot = &patchSnapshots.read();
+  if (noteCache != nullptr && (snapshot->fmModes[0] != fmModes[0] ||
+                               snapshot->fmModes[1] != fmModes[1])) {
+    // Cached audio is of the old routing, so catch up with it.
+    for (int i = 0; i < voices.getNumActive(); i++) {
+      VoiceState &voiceState = voiceStates[voices.getActiveVoices()[i]];
+      if (voiceState.cached != nullptr) {
+        leaveCache(voiceState);
+      }
     }
   }
-  if (FMmode[0] == 3) { // CROSS
-    if (voiceState.AMP[2] <= 4094) {
-      voiceState.M1 = ((lookupExp(lookupSin(voiceState.PAE[2] + voiceState.M2) +
-                                  voiceState.AMP[2]) +
-                        8192) >>
-                       2) &
-                      1023; // USE OPPOSITE MOD!
-    } else {
-      voiceState.M1 = 4095;
+  fmModes[0] = snapshot->fmModes[0];
+  fmModes[1] = snapshot->fmModes[1];
+
+  const int numPatches = snapshot->bank->getNumPatches();
+  for (auto &part : parts) {
+    part.patch = juce::jmin(part.patch, numPatches - 1);
+  }
+  if (snapshot->bank.get() != previousBank) {
+    return; // Patch numbers of sounding voices refer to the old bank.
+  }
+
+  for (int i = 0; i < voices.getNumActive(); i++) {
+    VoiceState &voiceState = voiceStates[voices.getActiveVoices()[i]];
+    if (voiceState.patch != snapshot->program) {
+      continue;
     }
-    if (voiceState.AMP[0] <= 4094) {
-      voiceState.CH1 = ((lookupExp(
-          lookupSin(voiceState.PAE[0] + voiceState.M1) + voiceState.AMP[0])));
-    } else {
-      voiceState.CH1 = 0;
+    if (voiceState.cached != nullptr &&
+        !noteCache->isCurrent(voiceState.patch, snapshot->edited, fmModes)) {
+      leaveCache(voiceState);
+    }
+    const KeyParams &key =
+        getKeyParams(voiceState.patch, int(voiceState.midiNote) + 24);
+    for (int n = 0; n < 4; n++) {
+      voiceState.targetCW[n] = key.CW[n];
+      gliding = gliding || voiceState.keyCW[n] != key.CW[n];
     }
   }
-  // CHANNEL2
-  if (FMmode[1] == 0) { // NORM
-    if (voiceState.AMP[3] <= 4094) {
-      voiceState.M2 =
-          ((lookupExp(lookupSin(voiceState.PAE[3]) + voiceState.AMP[3]) +
-            8192) >>
-           2) &
-          1023;
-    } else {
-      voiceState.M2 = 4095;
+}
+
+const PatchConsts &GS1_juceAudioProcessor::getPatchData(int patch) const {
+  return patch == snapshot->program ? snapshot->edited
+                                    : snapshot->bank->getPatch(patch);
+}
+
+const KeyParams &GS1_juceAudioProcessor::getKeyParams(int patch,
+                                                      int note) const {
+  note = juce::jlimit(0, KeyParams::numNotes - 1, note);
+  return patch == snapshot->program
+             ? snapshot->editedKeys[note]
+             : (*snapshot->bankKeys)[(size_t)(patch * KeyParams::numNotes +
+                                              note)];
+}
+
+void GS1_juceAudioProcessor::useBank(
+    std::shared_ptr<const PatchBank> newBank) {
+  bank = std::move(newBank);
+  auto keys = std::make_shared<std::vector<KeyParams>>(
+      (size_t)(bank->getNumPatches() * KeyParams::numNotes));
+  bankReleaseSeconds = 0;
+  for (int p = 0; p < bank->getNumPatches(); p++) {
+    KeyParams *patchKeys = &(*keys)[(size_t)(p * KeyParams::numNotes)];
+    computeKeyParams(bank->getPatch(p), patchKeys);
+    bankReleaseSeconds =
+        juce::jmax(bankReleaseSeconds, getReleaseSeconds(patchKeys[0]));
+  }
+  bankKeys = std::move(keys);
+}
+
+bool GS1_juceAudioProcessor::loadBank(const juce::File &file) {
+  auto newBank = PatchBank::open(file);
+  if (newBank == nullptr) {
+    return false;
+  }
+  useBank(std::move(newBank));
+  setCurrentProgram(juce::jmin(currentProgram.load(), getNumPrograms() - 1));
+  return true;
+}
+
+// Sets CW to keyCW moved by the pitch of the voice. One table lookup, and
+// no pitch leaves keyCW as it is bit for bit.
+static void applyPitch(VoiceState &voiceState) {
+  if (voiceState.pitch == 0) {
+    std::copy_n(voiceState.keyCW, 4, voiceState.CW);
+    return;
+  }
+  const double ratio = getPitchRatio(voiceState.pitch);
+  for (int n = 0; n < 4; n++) {
+    // Up to Nyquist, two steps per turn of the 28 bit phase.
+    voiceState.CW[n] =
+        int(juce::jmin(voiceState.keyCW[n] * ratio, double(1 << 27)));
+  }
+}
+
+// Moves keyCW a block-rate step towards targetCW, 20 ms time constant.
+void GS1_juceAudioProcessor::glideControlWords(int numSamples) {
+  if (!gliding) {
+    return;
+  }
+  gliding = false;
+  const double step = 1.0 - std::exp(-numSamples / (0.02 * SampleRate));
+  for (int i = 0; i < voices.getNumActive(); i++) {
+    VoiceState &voiceState = voiceStates[voices.getActiveVoices()[i]];
+    for (int n = 0; n < 4; n++) {
+      const int distance = voiceState.targetCW[n] - voiceState.keyCW[n];
+      const int move = int(distance * step);
+      voiceState.keyCW[n] += std::abs(move) > 0 ? move : distance;
+      gliding = gliding || voiceState.keyCW[n] != voiceState.targetCW[n];
     }
-    if (voiceState.AMP[1] <= 4094) {
-      voiceState.CH2 =
-          ((lookupExp(lookupSin(voiceState.PAE[1] + voiceState.M2) +
-                      voiceState.AMP[1]))); // 14bit output signed+-
-    } else {
-      voiceState.CH2 = 0;
-    }
-  }
-  if (FMmode[1] == 1) { // PI/2
-    if (voiceState.AMP[1] <= 4094) {
-      voiceState.M2 =
-          (lookupExp(
-               lookupSin(voiceState.PAE[3] +
-                         (((voiceState.M2old1 + voiceState.M2old2) / 2) >> 3)) +
-               voiceState.AMP[3]) +
-           8192) >>
-          4;
-    } else {
-      voiceState.M2 = 4095;
-    }
-    voiceState.M2old2 = voiceState.M2old1;
-    voiceState.M2old1 = voiceState.M2;
-    if (voiceState.AMP[1] <= 4094) {
-      voiceState.CH2 =
-          ((lookupExp(lookupSin(voiceState.PAE[1] + voiceState.M1) +
-                      voiceState.AMP[1]))); // 14bit output signed+-
-    } else {
-      voiceState.CH2 = 0;
-    }
-  }
-  if (FMmode[1] == 2) { // PI
-    if (voiceState.AMP[3] <= 4094) {
-      voiceState.M2 =
-          (lookupExp(
-               lookupSin(voiceState.PAE[3] +
-                         (((voiceState.M2old1 + voiceState.M2old2) / 2) >> 2)) +
-               voiceState.AMP[3]) +
-           8192) >>
-          4;
-    } else {
-      voiceState.M2 = 4095;
-    }
-    voiceState.M2old2 = voiceState.M2old1;
-    voiceState.M2old1 = voiceState.M2;
-    if (voiceState.AMP[1] <= 4094) {
-      voiceState.CH2 =
-          ((lookupExp(lookupSin(voiceState.PAE[1] + voiceState.M1) +
-                      voiceState.AMP[1]))); // 14bit output signed+-
-    } else {
-      voiceState.CH2 = 0;
+    applyPitch(voiceState);
+  }
+}
+
+//==============================================================================
+static void saveCheckpoint(const VoiceState &voiceState,
+                           VoiceCheckpoint &checkpoint) {
+  checkpoint.envelopes = voiceState.envelopes.getProgress();
+  std::copy_n(voiceState.PAI, 4, checkpoint.PAI);
+  checkpoint.M1 = voiceState.M1;
+  checkpoint.M2 = voiceState.M2;
+  checkpoint.M1old1 = voiceState.M1old1;
+  checkpoint.M1old2 = voiceState.M1old2;
+  checkpoint.M2old1 = voiceState.M2old1;
+  checkpoint.M2old2 = voiceState.M2old2;
+}
+
+static void restoreCheckpoint(const VoiceCheckpoint &checkpoint,
+                              VoiceState &voiceState) {
+  voiceState.envelopes.setProgress(checkpoint.envelopes);
+  std::copy_n(checkpoint.PAI, 4, voiceState.PAI);
+  voiceState.M1 = checkpoint.M1;
+  voiceState.M2 = checkpoint.M2;
+  voiceState.M1old1 = checkpoint.M1old1;
+  voiceState.M1old2 = checkpoint.M1old2;
+  voiceState.M2old1 = checkpoint.M2old1;
+  voiceState.M2old2 = checkpoint.M2old2;
+}
+
+// Every note of the cache, held from note on through noteOn() and
+// fmGenSample(), so playing it back is the engine bit for bit.
+static void renderNoteCache(NoteCache &cache,
+                            const std::vector<PatchConsts> &patches,
+                            FMSampleFn sampleFn) {
+  const int numKeys = cache.getHighKey() - cache.getLowKey() + 1;
+  const int numSamples = cache.getNumSamples();
+  auto job = [&](int index) {
+    const int slot = index / numKeys;
+    const int key = cache.getLowKey() + index % numKeys;
+    const KeyParams keyParams = computeKeyParams(patches[slot], key);
+    for (int layer = 0; layer < cache.getNumLayers(); layer++) {
+      const int note = cache.getNoteIndex(slot, key, layer);
+      int16_t *samples = cache.getSamples(note);
+      VoiceCheckpoint *checkpoints = cache.getCheckpoints(note);
+      VoiceState voiceState;
+      startVoice(voiceState, patches[slot], keyParams, slot, key - 24,
+                 127 - cache.getVelocity(layer));
+      for (int s = 0; s < numSamples; s++) {
+        if (s % NoteCache::checkpointInterval == 0) {
+          saveCheckpoint(voiceState,
+                         checkpoints[s / NoteCache::checkpointInterval]);
+        }
+        samples[s] = (int16_t)renderVoiceSample(voiceState, sampleFn);
+      }
+      saveCheckpoint(voiceState,
+                     checkpoints[numSamples / NoteCache::checkpointInterval]);
     }
+  };
+  WorkerPool pool(juce::jmax(0, juce::SystemStats::getNumCpus() - 1));
+  const int numJobs = (int)patches.size() * numKeys;
+  for (int first = 0; first < numJobs; first += WorkerPool::maxJobs) {
+    auto slice = [&](int index) { job(first + index); };
+    pool.run(juce::jmin(WorkerPool::maxJobs, numJobs - first), slice);
   }
-  if (FMmode[1] == 3) { // CROSSMOD
-    if (voiceState.AMP[3] <= 4094) {
-      voiceState.M2 = ((lookupExp(lookupSin(voiceState.PAE[3] + voiceState.M1) +
-                                  voiceState.AMP[3]) +
-                        8192) >>
-                       2) &
-                      1023; // USE OPPOSITE MOD!
-    } else {
-      voiceState.M2 = 4095;
+}
+
+bool GS1_juceAudioProcessor::enableNoteCache(
+    const NoteCacheSettings &settings) {
+  std::vector<int> numbers = settings.patches;
+  if (numbers.empty()) {
+    for (const auto &patch : partPatches) {
+      numbers.push_back(patch);
     }
-    if (voiceState.AMP[1] <= 4094) {
-      voiceState.CH2 = ((lookupExp(
-          lookupSin(voiceState.PAE[1] + voiceState.M2) + voiceState.AMP[1])));
-    } else {
-      voiceState.CH2 = 0;
+  }
+  std::sort(numbers.begin(), numbers.end());
+  numbers.erase(std::unique(numbers.begin(), numbers.end()), numbers.end());
+  numbers.erase(std::remove_if(numbers.begin(), numbers.end(),
+                               [this](int patch) {
+                                 return !juce::isPositiveAndBelow(
+                                     patch, bank->getNumPatches());
+                               }),
+                numbers.end());
+  const int numSamples = juce::roundToInt(settings.seconds * SampleRate);
+  if (numbers.empty() ||
+      !NoteCache::fits(numbers.size(), settings, numSamples)) {
+    return false;
+  }
+
+  // The patches as the audio thread plays them, with the current edits.
+  PatchConsts edited = bank->getPatch(currentProgram);
+  int modes[2];
+  patchParameters.read(edited, modes);
+  std::vector<PatchConsts> patches;
+  for (const int patch : numbers) {
+    patches.push_back(patch == currentProgram ? edited
+                                              : bank->getPatch(patch));
+  }
+
+  const juce::File file = bank->getFile() != juce::File()
+                              ? NoteCache::getFileFor(bank->getFile())
+                              : juce::File();
+  std::shared_ptr<NoteCache> cache;
+  if (file != juce::File()) {
+    cache = NoteCache::load(file);
+  }
+  if (cache == nullptr || !cache->matches(numbers, patches, modes[0],
+                                          modes[1], settings, numSamples)) {
+    cache = std::make_shared<NoteCache>(numbers, patches, modes[0], modes[1],
+                                        settings, numSamples);
+    renderNoteCache(*cache, patches, getFMSampleFn(modes[0], modes[1]));
+    if (file != juce::File()) {
+      cache->save(file);
     }
   }
-  return voiceState.CH1 +
-         voiceState.CH2; // Mix two stacks output and send to wave array
-}
 
-float cubicInterpolation(float v0, float v1, float v2, float v3, float t) {
-  float a0, a1, a2, a3;
+  disableNoteCache();
+  noteCache = std::move(cache);
+  return noteCache->getNumNotes() > 0;
+}
 
-  a0 = v3 - v2 - v0 + v1;
-  a1 = v0 - v1 - a0;
-  a2 = v2 - v0;
-  a3 = v1;
+void GS1_juceAudioProcessor::disableNoteCache() {
+  for (int i = 0; i < voices.getNumActive(); i++) {
+    VoiceState &voiceState = voiceStates[voices.getActiveVoices()[i]];
+    if (voiceState.cached != nullptr) {
+      leaveCache(voiceState);
+    }
+  }
+  noteCache.reset();
+}
 
-  return (a0 * (t * t * t)) + (a1 * (t * t)) + (a2 * t) + a3;
+// The voice continues live: from the checkpoint before its position, then
+// the per-voice engine up to it, less than checkpointInterval samples. The
+// rest of the voice state is as noteOn() left it.
+void GS1_juceAudioProcessor::leaveCache(VoiceState &voiceState) {
+  const int position = voiceState.cachePosition;
+  const int index = position / NoteCache::checkpointInterval;
+  restoreCheckpoint(voiceState.cached->checkpoints[index], voiceState);
+  voiceState.cached = nullptr;
+  for (int s = index * NoteCache::checkpointInterval; s < position; s++) {
+    fmGenSample(voiceState);
+  }
 }
 
-//==============================================================================
-GS1_juceAudioProcessor::GS1_juceAudioProcessor()
-    : AudioProcessor(
-          BusesProperties()
-              .withInput("Input", juce::AudioChannelSet::stereo(), true)
-              .withOutput("Output", juce::AudioChannelSet::stereo(), true)) {
-  for (int i = 0; i < 256; ++i) {
-    logsinTable[i] =
-        (round(-(log(sin(ceil(i + 0.5) * PI / 256 / 2)) / log(2)) * 256.0));
-    expTable[i] = (round((pow(2, i / 256.0) - 1) * 32768));
-  }
-  for (int i = 0; i < 4096; i++) {
-    Sin[i] = int(map(sin(map(i, 0, 4095, 0, HALF_PI)), 0, 1, 0, 5782));
-  }
-  for (int i = 0; i < 4096; i++) {
-    expTable2[i] = i;
-  }
-
-  float Ratio[] = {1, 7, 1, 15}; // C1,C2,M1,M2 Ratios.
-  int Detune[] = {0, 0, 5, 0};   // C1,C2,M1,M2 detune in cents +-16
-  float C1EC[] = {
-      0.0, 1,   0.5, 0.5, 0.5, 0.5, 0.6, 0.6, 0.7, 0.7, 0.8, 0.8,
-      0.9, 0.9, 0.9, 1,   1,   1,   1,   1,   1,   1,   1,   1,
-      1,   1,   1,   1,   1,   1,   1,   1,   1,   0.9, 0.9, 0.9,
-      0.8, 0.8, 0.7, 0.7, 0.6, 0.6, 0.5, 0.5, 0.4, 0.4}; // First lower and
-                                                         // upper limit(max amp
-                                                         // for velocity) then
-                                                         // 44(2key) settings.
-  float C2EC[] = {0.0, 0.06, 0.6,  0.6,  0.6,  0.6, 0.6, 0.6, 0.7, 0.7,
-                  0.7, 0.7,  0.7,  0.7,  0.6,  0.6, 0.5, 0.5, 0.4, 0.4,
-                  0.4, 0.4,  0.4,  0.4,  0.4,  0.4, 0.4, 0.3, 0.3, 0.3,
-                  0.3, 0.3,  0.2,  0.2,  0.2,  0.2, 0.1, 0.1, 0.1, 0.1,
-                  0.1, 0.05, 0.05, 0.05, 0.05, 0.05};
-  float M1EC[] = {0.0,  0.27, 1,    1,    1,    1,    1,    1,    0.9,  0.9,
-                  0.8,  0.8,  0.7,  0.7,  0.6,  0.6,  0.6,  0.6,  0.6,  0.6,
-                  0.6,  0.5,  0.5,  0.5,  0.4,  0.4,  0.3,  0.3,  0.3,  0.2,
-                  0.2,  0.1,  0.1,  0.1,  0.05, 0.05, 0.05, 0.01, 0.01, 0.01,
-                  0.01, 0.01, 0.01, 0.01, 0.01, 0.01};
-  float M2EC[] = {0.0, 0.3, 1,   1,   1,   1,   1,   0.9,  0.9, 0.8, 0.8, 0.7,
-                  0.7, 0.6, 0.5, 0.4, 0.3, 0.2, 0.1, 0.05, 0.0, 0.0, 0.0, 0.0,
-                  0,   0,   0,   0,   0,   0,   0,   0,    0,   0,   0,   0,
-                  0,   0,   0,   0,   0,   0,   0,   0,    0,   0};
-  float ATE[] = {2000, 2000, 1800, 3000};
-  memcpy(patches[1].Ratio, Ratio, sizeof(Ratio));
-  memcpy(patches[1].Detune, Detune, sizeof(Detune));
-  memcpy(patches[1].C1EC, C1EC, sizeof(C1EC));
-  memcpy(patches[1].C2EC, C2EC, sizeof(C2EC));
-  memcpy(patches[1].M1EC, M1EC, sizeof(M1EC));
-  memcpy(patches[1].M2EC, M2EC, sizeof(M2EC));
-  memcpy(patches[1].ATE, ATE, sizeof(ATE));
-  patches[1].DTE1Scaling = 15;
-}
-
-GS1_juceAudioProcessor::~GS1_juceAudioProcessor() {}
+// Before a render: cached voices that are bent, or would run out of cache
+// during it, continue live.
+void GS1_juceAudioProcessor::leaveCacheIfModulated(int numSamples) {
+  for (int i = 0; i < voices.getNumActive(); i++) {
+    VoiceState &voiceState = voiceStates[voices.getActiveVoices()[i]];
+    const int channel = voiceState.channel;
+    if (voiceState.cached != nullptr &&
+        (channelPitch[channel] != 0 || channelVibrato[channel] != 0 ||
+         voiceState.cachePosition + numSamples > noteCache->getNumSamples())) {
+      leaveCache(voiceState);
+    }
+  }
+}
 
 //==============================================================================
 const juce::String GS1_juceAudioProcessor::getName() const {
+#ifdef JucePlugin_Name
   return JucePlugin_Name;
+#else
+  return "GS1"; // Headless builds are not plugin projects.
+#endif
 }
 
 bool GS1_juceAudioProcessor::acceptsMidi() const { return true; }
@@ -496,21 +541,58 @@ bool GS1_juceAudioProcessor::producesMidi() const { return false; }
 
 bool GS1_juceAudioProcessor::isMidiEffect() const { return false; }
 
-double GS1_juceAudioProcessor::getTailLengthSeconds() const { return 0.0; }
+double GS1_juceAudioProcessor::getTailLengthSeconds() const {
+  return tailSeconds;
+}
 
-int GS1_juceAudioProcessor::getNumPrograms() { return 2; }
+int GS1_juceAudioProcessor::getNumPrograms() { return bank->getNumPatches(); }
 
-int GS1_juceAudioProcessor::getCurrentProgram() { return currentPatch; }
+int GS1_juceAudioProcessor::getCurrentProgram() { return currentProgram; }
 
+// Loads the program into the parameters and moves every part to it.
 void GS1_juceAudioProcessor::setCurrentProgram(int index) {
-  currentPatch = index;
+  index = juce::jlimit(0, getNumPrograms() - 1, index);
+  currentProgram = index;
+  patchParameters.load(bank->getPatch(index));
+  publishPatch();
+  for (int p = 0; p < numParts; p++) {
+    setPartPatch(p, index);
+  }
+}
+
+// The bank may change until the audio thread takes it, so the patch number is
+// only checked against the snapshot there.
+void GS1_juceAudioProcessor::setPartPatch(int part, int patch) {
+  partPatches[part] = juce::jmax(0, patch);
+  pendingPatches[part] = juce::jmax(0, patch);
+}
+
+// A limit above the polyphony has no effect.
+void GS1_juceAudioProcessor::setPartVoiceLimit(int part, int maxVoices) {
+  partVoiceLimits[part] = juce::jmax(1, maxVoices);
+}
+
+void GS1_juceAudioProcessor::setPolyphony(int polyphony) {
+  requestedPolyphony = juce::jlimit(minPolyphony, maxPolyphony, polyphony);
+}
+
+// Every voice free and silent.
+void GS1_juceAudioProcessor::allocateVoices(int polyphony) {
+  numVoices = polyphony;
+  voiceStates.assign((size_t)numVoices, VoiceState());
+  voices.setSize(numVoices, numParts);
+  restoredVoiceStates.assign((size_t)numVoices, VoiceState());
+  restoredVoices.setSize(numVoices, numParts);
+  for (auto &part : parts) {
+    part.numVoices = 0;
+  }
+  outputVoices.assign((size_t)((1 + numParts) * numVoices), 0);
+  liveVoices.assign((size_t)numVoices, 0);
 }
 
 const juce::String GS1_juceAudioProcessor::getProgramName(int index) {
-  if (index == 0) {
-    return "EP11";
-  } else if (index == 1) {
-    return "EP22";
+  if (juce::isPositiveAndBelow(index, getNumPrograms())) {
+    return bank->getName(index);
   }
   return {};
 }
@@ -518,29 +600,45 @@ const juce::String GS1_juceAudioProcessor::getProgramName(int index) {
 void GS1_juceAudioProcessor::changeProgramName(int index,
                                                const juce::String &newName) {}
 
+void GS1_juceAudioProcessor::setFMModes(int ch1Mode, int ch2Mode) {
+  patchParameters.setFMModes(ch1Mode, ch2Mode);
+  publishPatch();
+}
+
 //==============================================================================
 void GS1_juceAudioProcessor::prepareToPlay(double sampleRate,
                                            int samplesPerBlock) {
-  juce::dsp::ProcessSpec spec;
-  spec.maximumBlockSize = samplesPerBlock;
-  spec.sampleRate = sampleRate;
-  spec.numChannels = 1;
-
-  delayA = juce::dsp::DelayLine<float,
-                                juce::dsp::DelayLineInterpolationTypes::Linear>{
-      1024};
-  delayB = juce::dsp::DelayLine<float,
-                                juce::dsp::DelayLineInterpolationTypes::Linear>{
-      1024};
-  delayC = juce::dsp::DelayLine<float,
-                                juce::dsp::DelayLineInterpolationTypes::Linear>{
-      1024};
-  delayA.prepare(spec);
-  delayB.prepare(spec);
-  delayC.prepare(spec);
-  delayA.reset();
-  delayB.reset();
-  delayC.reset();
+  if (requestedPolyphony != numVoices) {
+    allocateVoices(requestedPolyphony);
+  }
+
+  // The engine always runs at the GS1 rate, the resampler converts to the
+  // host rate.
+  maxBlockSize = samplesPerBlock;
+
+  numOutputs = 1;
+  for (int p = 0; p < numParts; p++) {
+    const auto *bus = getBus(false, 1 + p);
+    parts[p].output = bus != nullptr && bus->isEnabled() ? numOutputs++ : 0;
+  }
+
+  resampler.prepare(SampleRate, sampleRate, samplesPerBlock, 2 * numOutputs);
+  engineBuffer.setSize(numOutputs, resampler.getMaxInputBlock());
+  for (auto &group : voiceGroups) {
+    group.sums.resize(engineBuffer.getNumSamples());
+    group.batchSums.resize(engineBuffer.getNumSamples());
+  }
+  vibratoLfo.assign(
+      engineBuffer.getNumSamples() / FMAmpBlock::maxSamples + 1, 0.0f);
+  cacheSums.resize(engineBuffer.getNumSamples());
+  setLatencySamples(resampler.getLatencyInOutputSamples());
+
+  for (int o = 0; o < numOutputs; o++) {
+    choruses[o].prepare(SampleRate);
+  }
+  drainSamples = choruses[0].getDrainSamples() + Resampler::numTaps;
+  silentSamples = drainSamples; // Both start out empty.
+  display.prepare(sampleRate);
 }
 
 void GS1_juceAudioProcessor::releaseResources() {
@@ -553,99 +651,611 @@ bool GS1_juceAudioProcessor::isBusesLayoutSupported(
   if (layouts.getMainOutputChannelSet() != juce::AudioChannelSet::stereo())
     return false;
 
+  // Part outputs are stereo or off.
+  const int numBuses = static_cast<int>(layouts.outputBuses.size());
+  for (int bus = 1; bus < numBuses; bus++) {
+    const auto set = layouts.getChannelSet(false, bus);
+    if (!set.isDisabled() && set != juce::AudioChannelSet::stereo())
+      return false;
+  }
+
   return true;
 }
 
+// A voice is done once the gate is off and every envelope has run down to
+// zero, which mutes all operators. From then on fmGenSample() can only return
+// 0 until the next noteOn.
+static bool isVoiceFinished(const VoiceState &voiceState) {
+  return voiceState.GATE == 0 && voiceState.envelopes.isIdle();
+}
+
+// Steals from the releasing voices first, the quietest one, then from notes
+// only held by the pedal and last from held keys, the oldest in both. part < 0
+// takes any voice.
+int GS1_juceAudioProcessor::stealVoice(int part) {
+  int quietest = -1;
+  int quietestAttenuation = -1;
+  for (int v = voices.getFirst(VoiceAllocator::releasingList); v >= 0;
+       v = voices.getNext(v)) {
+    if (part >= 0 && voiceStates[v].part != part) {
+      continue;
+    }
+    // The louder of the two carriers.
+    const auto &envelopes = voiceStates[v].envelopes;
+    const int attenuation =
+        juce::jmin(envelopes.getAttenuation(0), envelopes.getAttenuation(1));
+    if (attenuation > quietestAttenuation) {
+      quietest = v;
+      quietestAttenuation = attenuation;
+    }
+  }
+  if (quietest >= 0) {
+    return quietest;
+  }
+
+  int oldest = -1;
+  auto findOldest = [&](int list) {
+    for (int v = voices.getFirst(list); v >= 0; v = voices.getNext(v)) {
+      if (part < 0 || voiceStates[v].part == part) {
+        if (oldest < 0 || int32_t(voiceStates[v].noteIndex -
+                                  voiceStates[oldest].noteIndex) < 0) {
+          oldest = v;
+        }
+        return; // Lists run oldest first.
+      }
+    }
+  };
+  for (int p = 0; p < numParts; p++) {
+    if (part < 0 || part == p) {
+      findOldest(VoiceAllocator::firstSustainedList + p);
+    }
+  }
+  if (oldest < 0) {
+    findOldest(VoiceAllocator::heldList);
+  }
+  return oldest;
+}
+
+// Notes are told apart by channel, voice limits count per part.
+int GS1_juceAudioProcessor::allocateVoice(int part, int channel, int note) {
+  // The same note again restarts the voice that is playing it. A voice of
+  // another part, left from before MPE was switched, ends instead and the
+  // note gets a voice of its own part.
+  int voice = voices.findNote(channel, note);
+  if (voice >= 0 && voiceStates[voice].part != part) {
+    releaseVoice(voice);
+    voices.clearNote(voice);
+    voice = -1;
+  }
+  if (voice < 0) {
+    Part &target = parts[part];
+    if (target.numVoices >= target.maxVoices) {
+      voice = stealVoice(part);
+      profiler.noteStolen();
+    } else {
+      if (voices.getNumFree() > 0) {
+        voice = voices.getFirst(VoiceAllocator::freeList);
+      } else {
+        voice = stealVoice(-1);
+        parts[voiceStates[voice].part].numVoices--;
+        profiler.noteStolen();
+      }
+      target.numVoices++;
+    }
+  }
+  voices.setNote(voice, channel, note);
+  voices.moveTo(voice, VoiceAllocator::heldList);
+  return voice;
+}
+
+// Closes the gate, the envelopes run down live.
+void GS1_juceAudioProcessor::releaseVoice(int voice) {
+  VoiceState &voiceState = voiceStates[voice];
+  if (voiceState.cached != nullptr) {
+    leaveCache(voiceState);
+  }
+  voiceState.GATE = 0;
+  voices.moveTo(voice, VoiceAllocator::releasingList);
+}
+
+void GS1_juceAudioProcessor::freeVoice(int voice) {
+  voices.clearNote(voice);
+  voices.moveTo(voice, VoiceAllocator::freeList);
+  parts[voiceStates[voice].part].numVoices--;
+}
+
+// Only released voices can finish.
+void GS1_juceAudioProcessor::releaseFinishedVoices() {
+  for (int v = voices.getFirst(VoiceAllocator::releasingList); v >= 0;) {
+    const int nextVoice = voices.getNext(v);
+    if (isVoiceFinished(voiceStates[v])) {
+      freeVoice(v);
+    }
+    v = nextVoice;
+  }
+}
+
+void GS1_juceAudioProcessor::handleMidiEvent(
+    const juce::MidiMessage &message) {
+  const int channel = message.getChannel();
+  if (channel < 1) {
+    return; // Sysex and meta events.
+  }
+  // With MPE the member channels play the part of master channel 1, each
+  // with its own pitch wheel.
+  const PerformanceSettings &performance = snapshot->performance;
+  const int part = performance.mpe ? 0 : channel - 1;
+  Part &target = parts[part];
+
+  if (message.isNoteOn()) {
+    const int note = message.getNoteNumber();
+    int velocity = message.getVelocity();
+    const bool glides = performance.portamentoTime > 0 && target.lastNote >= 0;
+    const CachedNote *cached = nullptr;
+    if (noteCache != nullptr && !glides) {
+      cached = noteCache->find(target.patch, getPatchData(target.patch),
+                               fmModes, note, velocity);
+      velocity = cached != nullptr ? noteCache->getLayerVelocity(velocity)
+                                   : velocity;
+    }
+    VoiceState &voiceState =
+        voiceStates[allocateVoice(part, channel - 1, note)];
+    noteOn(voiceState, target.patch, note - 24, 127 - velocity);
+    voiceState.part = part;
+    voiceState.channel = channel - 1;
+    voiceState.noteIndex = noteCounter++;
+    voiceState.cached = cached;
+    voiceState.cachePosition = 0;
+    // Constant time whatever the interval.
+    if (glides) {
+      voiceState.portamento = float(target.lastNote - note);
+      voiceState.portamentoStep = std::abs(voiceState.portamento) /
+                                  (performance.portamentoTime * SampleRate);
+    }
+    target.lastNote = note;
+  } else if (message.isNoteOff()) {
+    // The pedal of the part the voice plays for, which is not this one if
+    // MPE was switched since the note on.
+    const int voice = voices.findNote(channel - 1, message.getNoteNumber());
+    if (voice >= 0 && voices.getList(voice) == VoiceAllocator::heldList) {
+      VoiceState &voiceState = voiceStates[voice];
+      voiceState.noteOn = false;
+      if (parts[voiceState.part].sustainPedal) {
+        voices.moveTo(voice,
+                      VoiceAllocator::firstSustainedList + voiceState.part);
+      } else {
+        releaseVoice(voice);
+      }
+    }
+  } else if (message.isSustainPedalOff()) {
+    target.sustainPedal = false;
+    const int sustained = VoiceAllocator::firstSustainedList + part;
+    for (int v = voices.getFirst(sustained); v >= 0;
+         v = voices.getFirst(sustained)) {
+      releaseVoice(v);
+    }
+  } else if (message.isSustainPedalOn()) {
+    target.sustainPedal = true;
+  } else if (message.isProgramChange()) {
+    setPartPatch(part, message.getProgramChangeNumber());
+  } else if (message.isPitchWheel()) {
+    const int value = message.getPitchWheelValue() - 8192;
+    pitchWheels[channel - 1] = value / (value > 0 ? 8191.0f : 8192.0f);
+  } else if (message.isControllerOfType(1)) {
+    modWheels[channel - 1] = message.getControllerValue() / 127.0f;
+  } else if (message.isResetAllControllers()) {
+    pitchWheels[channel - 1] = 0;
+    modWheels[channel - 1] = 0;
+  }
+}
+
 void GS1_juceAudioProcessor::processBlock(juce::AudioBuffer<float> &buffer,
                                           juce::MidiBuffer &midiMessages) {
   juce::ScopedNoDenormals noDenormals;
+  // Not prepared yet: there is nothing to render with, and no sub-block size.
+  if (maxBlockSize <= 0) {
+    buffer.clear();
+    return;
+  }
+  profiler.beginBlock(buffer.getNumSamples(), getSampleRate());
   auto totalNumInputChannels = getTotalNumInputChannels();
   auto totalNumOutputChannels = getTotalNumOutputChannels();
 
   for (auto i = totalNumInputChannels; i < totalNumOutputChannels; ++i)
     buffer.clear(i, 0, buffer.getNumSamples());
 
-  for (size_t i = 0; i < buffer.getNumSamples(); i++) {
-    for (const auto metadata : midiMessages) {
-      auto message = metadata.getMessage();
-      if (metadata.samplePosition != i) {
-        continue;
+  // Patch edits and program changes from other threads.
+  if (patchSnapshots.acquire()) {
+    applyPatch();
+  }
+  for (int p = 0; p < numParts; p++) {
+    const int patch = pendingPatches[p].exchange(-1);
+    if (patch >= 0) {
+      parts[p].patch = juce::jmin(patch, snapshot->bank->getNumPatches() - 1);
+    }
+    parts[p].maxVoices = partVoiceLimits[p];
+  }
+  profiler.lap(EngineProfiler::control);
+
+  // Nothing left that could make a sound: skip the engine altogether.
+  outputSilent = voices.getNumActive() == 0 && midiMessages.isEmpty() &&
+                 silentSamples >= drainSamples;
+  if (outputSilent) {
+    buffer.clear();
+    profiler.idleBlock();
+    profiler.endBlock(0, fmModes[0], fmModes[1]);
+    publishDisplay(buffer);
+    return;
+  }
+
+  // Hosts may send more than they announced in prepareToPlay.
+  for (int start = 0; start < buffer.getNumSamples(); start += maxBlockSize) {
+    renderBlock(buffer, midiMessages, start,
+                juce::jmin(maxBlockSize, buffer.getNumSamples() - start));
+  }
+  profiler.endBlock(voices.getNumActive(), fmModes[0], fmModes[1]);
+  publishDisplay(buffer);
+}
+
+// The editor's view of the main output and the voices, the first
+// VoiceFrame::maxVoices of them. Costs one check while no editor is open.
+void GS1_juceAudioProcessor::publishDisplay(
+    const juce::AudioBuffer<float> &buffer) {
+  if (!display.isReaderAttached()) {
+    return;
+  }
+  const int numSamples = buffer.getNumSamples();
+  display.addOutput(buffer.getReadPointer(0),
+                    buffer.getReadPointer(buffer.getNumChannels() > 1 ? 1 : 0),
+                    numSamples);
+  if (!display.isFrameDue(numSamples,
+                          profiler.getLastBlock().deadlineRatio)) {
+    return;
+  }
+  VoiceFrame frame;
+  frame.numVoices = juce::jmin(numVoices, VoiceFrame::maxVoices);
+  for (int v = 0; v < frame.numVoices; v++) {
+    const auto list = voices.getList(v);
+    frame.lists[v] = (uint8_t)juce::jmin<int>(
+        list, VoiceAllocator::firstSustainedList);
+    if (list != VoiceAllocator::freeList) {
+      const VoiceState &voiceState = voiceStates[v];
+      OperatorEnvelopes envelopes = voiceState.envelopes;
+      if (voiceState.cached != nullptr) {
+        // Cached voices: the levels at the last checkpoint.
+        envelopes.setProgress(
+            voiceState.cached
+                ->checkpoints[voiceState.cachePosition /
+                              NoteCache::checkpointInterval]
+                .envelopes);
       }
+      const int attenuation = juce::jmin(envelopes.getAttenuation(0),
+                                         envelopes.getAttenuation(1));
+      frame.levels[v] = 1.0f - attenuation / 4095.0f;
+    }
+  }
+  frame.numActive = voices.getNumActive();
+  display.pushFrame(frame);
+}
 
-      if (message.isNoteOn()) {
-        noteOn(voiceStates[lastVoice], message.getNoteNumber() - 24,
-               127 - message.getVelocity());
-        lastVoice = (lastVoice + 1) % 32;
-      } else if (message.isNoteOff()) {
-        for (size_t nVoice = 0; nVoice < 32; nVoice++) {
-          if (voiceStates[nVoice].midiNote == message.getNoteNumber() - 24) {
-            if (!voiceStates[nVoice].sustaining) {
-              voiceStates[nVoice].GATENEW = 0;
-            }
-            voiceStates[nVoice].noteOn = false;
-          }
-        }
-      } else if (message.isSustainPedalOff()) {
-        for (size_t nVoice = 0; nVoice < 32; nVoice++) {
-          if (!voiceStates[nVoice].noteOn) {
-            voiceStates[nVoice].GATENEW = 0;
-            voiceStates[nVoice].noteOn = false;
-            voiceStates[nVoice].sustaining = false;
-          }
-        }
-      } else if (message.isSustainPedalOn()) {
-        for (size_t nVoice = 0; nVoice < 32; nVoice++) {
-          voiceStates[nVoice].sustaining = true;
+void GS1_juceAudioProcessor::setKernelIsa(FMKernelIsa isa) {
+  kernelIsa = isa;
+  kernel = getFMKernel(kernelIsa, kernelLookup);
+}
+
+void GS1_juceAudioProcessor::setKernelLookup(FMLookup lookup) {
+  kernelLookup = lookup;
+  kernel = getFMKernel(kernelIsa, kernelLookup);
+}
+
+// Slices of the voices per render thread. A worker that wakes late then only
+// holds up the slice it took, the caller renders the ones still left.
+static constexpr int slicesPerThread = 4;
+
+void GS1_juceAudioProcessor::setRenderThreads(int numThreads) {
+  workers.reset();
+  if (numThreads > 0) {
+    workers = std::make_unique<WorkerPool>(numThreads, true);
+  }
+  voiceGroups.resize(numThreads > 0 ? (numThreads + 1) * slicesPerThread : 1);
+  for (auto &group : voiceGroups) {
+    group.sums.resize(engineBuffer.getNumSamples());
+    group.batchSums.resize(engineBuffer.getNumSamples());
+  }
+}
+
+// Copies the operator state of a slice of voices into kernel lanes. Lanes
+// past the last voice are padding: no phase, and muted for the whole block.
+void GS1_juceAudioProcessor::loadLanes(VoiceGroup &group, const int *voices,
+                                       int count) {
+  FMLanes &lanes = group.lanes;
+  const int width = kernel.laneWidth;
+  lanes.numLanes = (count + width - 1) / width * width;
+  for (int v = 0; v < lanes.numLanes; v++) {
+    const bool padding = v >= count;
+    const VoiceState &voiceState = voiceStates[padding ? 0 : voices[v]];
+    for (int n = 0; n < 4; n++) {
+      lanes.PAI[n][v] = padding ? 0 : voiceState.PAI[n];
+      lanes.CW[n][v] = padding ? 0 : voiceState.CW[n];
+    }
+    lanes.M1[v] = padding ? 0 : voiceState.M1;
+    lanes.M2[v] = padding ? 0 : voiceState.M2;
+    lanes.M1old1[v] = padding ? 0 : voiceState.M1old1;
+    lanes.M1old2[v] = padding ? 0 : voiceState.M1old2;
+    lanes.M2old1[v] = padding ? 0 : voiceState.M2old1;
+    lanes.M2old2[v] = padding ? 0 : voiceState.M2old2;
+    if (padding) {
+      for (int s = 0; s < FMAmpBlock::maxSamples; s++) {
+        for (int n = 0; n < 4; n++) {
+          group.amps.amp[s][n][v] = 4095;
         }
       }
     }
+  }
+}
+
+void GS1_juceAudioProcessor::storeLanes(const VoiceGroup &group,
+                                        const int *voices, int count) {
+  const FMLanes &lanes = group.lanes;
+  for (int v = 0; v < count; v++) {
+    VoiceState &voiceState = voiceStates[voices[v]];
+    for (int n = 0; n < 4; n++) {
+      voiceState.PAI[n] = lanes.PAI[n][v];
+    }
+    voiceState.M1 = lanes.M1[v];
+    voiceState.M2 = lanes.M2[v];
+    voiceState.M1old1 = lanes.M1old1[v];
+    voiceState.M1old2 = lanes.M1old2[v];
+    voiceState.M2old1 = lanes.M2old1[v];
+    voiceState.M2old2 = lanes.M2old2[v];
+  }
+}
+
+// Envelopes run per voice over the whole chunk and feed the attenuation of
+// each sample to the kernel, which runs the operators of the voices side by
+// side, FMLanes::maxLanes at a time. Touches only these voices and the
+// group.
+void GS1_juceAudioProcessor::renderVoiceGroup(VoiceGroup &group,
+                                              const int *voices, int count,
+                                              int numSamples) {
+  const FMKernelFn render = kernel.render[fmModes[0]][fmModes[1]];
+  for (int first = 0; first < count; first += FMLanes::maxLanes) {
+    const int *batch = voices + first;
+    const int batchCount = juce::jmin(FMLanes::maxLanes, count - first);
+    int32_t *sums = first == 0 ? group.sums.data() : group.batchSums.data();
+    loadLanes(group, batch, batchCount);
+    for (int start = 0; start < numSamples; start += FMAmpBlock::maxSamples) {
+      const int chunk = juce::jmin(FMAmpBlock::maxSamples, numSamples - start);
+      modulatePitch(group.lanes, batch, batchCount,
+                    start / FMAmpBlock::maxSamples, chunk);
+      for (int v = 0; v < batchCount; v++) {
+        VoiceState &voiceState = voiceStates[batch[v]];
+        voiceState.envelopes.render(voiceState.GATE != 0, chunk,
+                                    &group.amps.amp[0][0][v],
+                                    FMLanes::maxLanes, 4 * FMLanes::maxLanes);
+      }
+      render(group.lanes, group.amps, chunk, sums + start);
+    }
+    storeLanes(group, batch, batchCount);
+    if (first > 0) {
+      for (int s = 0; s < numSamples; s++) {
+        group.sums[s] += group.batchSums[s];
+      }
+    }
+  }
+}
+
+// Control rate pitch, once per kernel chunk: wheels, vibrato and portamento
+// add up to one offset per voice, and only voices whose offset moved get
+// new control words.
+void GS1_juceAudioProcessor::modulatePitch(FMLanes &lanes, const int *voices,
+                                           int count, int chunk,
+                                           int numSamples) {
+  const float lfo = vibratoLfo[chunk];
+  for (int v = 0; v < count; v++) {
+    VoiceState &voiceState = voiceStates[voices[v]];
+    const int channel = voiceState.channel;
+    const float pitch = channelPitch[channel] +
+                        channelVibrato[channel] * lfo + voiceState.portamento;
+    if (voiceState.portamento != 0) {
+      const float step = voiceState.portamentoStep * numSamples;
+      voiceState.portamento =
+          voiceState.portamento > 0
+              ? juce::jmax(0.0f, voiceState.portamento - step)
+              : juce::jmin(0.0f, voiceState.portamento + step);
+    }
+    if (pitch != voiceState.pitch) {
+      voiceState.pitch = pitch;
+      applyPitch(voiceState);
+      for (int n = 0; n < 4; n++) {
+        lanes.CW[n][v] = voiceState.CW[n];
+      }
+    }
+  }
+}
+
+// Audio thread, before a render: the offsets the wheels of every channel
+// ask for, and the vibrato LFO at the start of each kernel chunk. One sin()
+// per chunk, shared by all voices.
+void GS1_juceAudioProcessor::updatePitchControls(int numSamples) {
+  const PerformanceSettings &performance = snapshot->performance;
+  for (int c = 0; c < numParts; c++) {
+    channelPitch[c] = pitchWheels[c] * (performance.mpe && c > 0
+                                            ? performance.mpeBendRange
+                                            : performance.bendRange);
+    if (performance.mpe && c > 0) {
+      channelPitch[c] += pitchWheels[0] * performance.bendRange;
+    }
+    const float modWheel = modWheels[performance.mpe ? 0 : c];
+    channelVibrato[c] =
+        (performance.vibratoDepth + modWheel * performance.modWheelDepth) *
+        0.01f;
+  }
+
+  const double increment = performance.vibratoRate / (double)SampleRate;
+  for (int k = 0; k * FMAmpBlock::maxSamples < numSamples; k++) {
+    const double phase = vibratoPhase + k * FMAmpBlock::maxSamples * increment;
+    vibratoLfo[k] =
+        (float)std::sin(juce::MathConstants<double>::twoPi * phase);
+  }
+  vibratoPhase += numSamples * increment;
+  vibratoPhase -= std::floor(vibratoPhase);
+}
+
+// Fewer voices than this per slice cost more in dispatch than they save.
+static constexpr int minVoicesPerGroup = 8;
 
-    int sumSample = 0;
-    for (size_t nVoice = 0; nVoice < 32; nVoice++) {
-      sumSample += fmGenSample(voiceStates[nVoice]);
+void GS1_juceAudioProcessor::renderVoiceList(const int *voices, int count,
+                                             float *mix, int startSample,
+                                             int endSample) {
+  if (count == 0) {
+    for (int i = startSample; i < endSample; i++) {
+      mix[i] = 0;
+    }
+    return;
+  }
+
+  const int numSamples = endSample - startSample;
+
+  // Cached voices only add up their samples, the others go to the engine.
+  int *live = liveVoices.data();
+  int numLive = 0;
+  bool anyCached = false;
+  for (int i = 0; i < count; i++) {
+    VoiceState &voiceState = voiceStates[voices[i]];
+    if (voiceState.cached == nullptr) {
+      live[numLive++] = voices[i];
+      continue;
+    }
+    if (!anyCached) {
+      std::fill_n(cacheSums.data(), numSamples, 0);
+      anyCached = true;
+    }
+    const int16_t *samples =
+        voiceState.cached->samples + voiceState.cachePosition;
+    for (int s = 0; s < numSamples; s++) {
+      cacheSums[s] += samples[s];
     }
-    float sample = map(sumSample, -262144 / 6, 262112 / 6, -1, 1);
-    delayA.pushSample(0, sample);
-    delayB.pushSample(0, sample);
-    delayC.pushSample(0, sample);
+    voiceState.cachePosition += numSamples;
   }
 
-  float *channelDataL = buffer.getWritePointer(0);
-  float *channelDataR = buffer.getWritePointer(1);
+  int numGroups = numLive == 0 ? 0
+                               : juce::jlimit(1, (int)voiceGroups.size(),
+                                              numLive / minVoicesPerGroup);
+  if (numGroups == 1) {
+    renderVoiceGroup(voiceGroups[0], live, numLive, numSamples);
+  } else if (numGroups > 1) {
+    // Slices are whole kernel lanes wide so no lane group is split.
+    const int width = kernel.laneWidth;
+    const int perGroup =
+        ((numLive + numGroups - 1) / numGroups + width - 1) / width * width;
+    numGroups = (numLive + perGroup - 1) / perGroup;
+    auto job = [this, live, numLive, perGroup, numSamples](int g) {
+      const int first = g * perGroup;
+      renderVoiceGroup(voiceGroups[g], live + first,
+                       juce::jmin(perGroup, numLive - first), numSamples);
+    };
+    workers->run(numGroups, job);
+  }
 
-  // bypass
-  // for (int i = 0; i < buffer.getNumSamples(); i++) {
-  //   channelDataL[i] = map(outSamples[i], -262144/6, 262112/6, -1, 1);
-  //   channelDataR[i] = map(outSamples[i], -262144/6, 262112/6, -1, 1);
-  // }
+  // Integer sums, so the slicing can't change the result.
+  for (int s = 0; s < numSamples; s++) {
+    int32_t sum = anyCached ? cacheSums[s] : 0;
+    for (int g = 0; g < numGroups; g++) {
+      sum += voiceGroups[g].sums[s];
+    }
+    mix[startSample + s] = toMixSample(sum);
+  }
+}
 
-  // chorus
-  for (int i = 0; i < buffer.getNumSamples(); i++) {
-    chorusPos++;
+// Parts only pick the patch at note on, so all voices of one output render
+// together whatever part they belong to.
+void GS1_juceAudioProcessor::renderVoices(int startSample, int endSample) {
+  const int *activeVoices = voices.getActiveVoices();
+  const int numActiveVoices = voices.getNumActive();
+  silentSamples = numActiveVoices > 0
+                      ? 0
+                      : juce::jmin(drainSamples,
+                                   silentSamples + endSample - startSample);
+  if (numActiveVoices > 0) {
+    updatePitchControls(endSample - startSample);
+    if (noteCache != nullptr) {
+      leaveCacheIfModulated(endSample - startSample);
+    }
+  }
+  if (numOutputs == 1) {
+    renderVoiceList(activeVoices, numActiveVoices,
+                    engineBuffer.getWritePointer(0), startSample, endSample);
+  } else {
+    for (int o = 0; o < numOutputs; o++) {
+      numOutputVoices[o] = 0;
+    }
+    for (int i = 0; i < numActiveVoices; i++) {
+      const int output = parts[voiceStates[activeVoices[i]].part].output;
+      outputVoices[(size_t)(output * numVoices + numOutputVoices[output]++)] =
+          activeVoices[i];
+    }
+    for (int o = 0; o < numOutputs; o++) {
+      renderVoiceList(&outputVoices[(size_t)(o * numVoices)],
+                      numOutputVoices[o],
+                      engineBuffer.getWritePointer(o), startSample, endSample);
+    }
+  }
+  releaseFinishedVoices();
+}
 
-    float A1 = sin(map((chorusPos & 65535), 0, 65535, 0, 6.28));
-    float B1 = sin(map((chorusPos & 65535), 0, 6553.5, 0, 6.28));
-    // Slightly random to make more analog effect feel
-    float lup1 = map(((A1 * 2.7) + B1) / 3.7, -1, 1, 0, 61);
-    float A2 =
-        sin(map(((chorusPos & 65535) + 21845) & 65535, 0, 65535, 0, 6.28));
-    float B2 =
-        sin(map(((chorusPos & 65535) + 21845) & 65535, 0, 6553.5, 0, 6.28));
-    float lup2 = map(((A2 * 2.7) + B2) / 3.7, -1, 1, 0, 60);
-    float A3 =
-        sin(map(((chorusPos & 65535) + 43690) & 65535, 0, 65535, 0, 6.28));
-    float B3 =
-        sin(map(((chorusPos & 65535) + 43690) & 65535, 0, 6553.5, 0, 6.28));
-    float lup3 = map(((A3 * 2.7) + B3) / 3.7, -1, 1, 0, 63);
+void GS1_juceAudioProcessor::renderBlock(juce::AudioBuffer<float> &buffer,
+                                         juce::MidiBuffer &midiMessages,
+                                         int startSample, int numSamples) {
+  // Voices and chorus run at the engine rate, MIDI timestamps are mapped onto
+  // engine samples.
+  const int numEngineSamples = resampler.getInputSamplesNeeded(numSamples);
+  glideControlWords(numEngineSamples);
+  profiler.lap(EngineProfiler::control);
 
-    delayA.setDelay(lup1);
-    delayB.setDelay(lup2);
-    delayC.setDelay(lup3);
+  // Split the block at event boundaries: each event is dispatched once and
+  // the event-free runs in between are rendered in one go.
+  int renderedSamples = 0;
+  for (auto it = midiMessages.findNextSamplePosition(startSample);
+       it != midiMessages.end(); ++it) {
+    const auto metadata = *it;
+    const int pos = metadata.samplePosition - startSample;
+    if (pos >= numSamples) {
+      break;
+    }
+    const int eventSample =
+        juce::jmin(resampler.getInputIndex(pos), numEngineSamples);
+    renderVoices(renderedSamples, eventSample);
+    profiler.lap(EngineProfiler::render);
+    renderedSamples = eventSample;
+    handleMidiEvent(metadata.getMessage());
+    profiler.lap(EngineProfiler::midi);
+  }
+  renderVoices(renderedSamples, numEngineSamples);
+  profiler.lap(EngineProfiler::render);
 
-    float sampA = delayA.popSample(0);
-    channelDataL[i] = (sampA / 2) + delayC.popSample(0);
-    channelDataR[i] = (sampA / 2) + delayB.popSample(0);
+  // One resampler carries every output, main first then the part buses in
+  // bus order.
+  float *outputs[2 * (1 + numParts)];
+  for (int o = 0; o < numOutputs; o++) {
+    choruses[o].process(engineBuffer.getReadPointer(o),
+                        resampler.getInputPointer(2 * o),
+                        resampler.getInputPointer(2 * o + 1), numEngineSamples);
+  }
+  profiler.lap(EngineProfiler::chorus);
+  outputs[0] = buffer.getWritePointer(0, startSample);
+  outputs[1] = buffer.getWritePointer(1, startSample);
+  for (int p = 0; p < numParts; p++) {
+    const int o = parts[p].output;
+    if (o > 0) {
+      for (int c = 0; c < 2; c++) {
+        outputs[2 * o + c] = buffer.getWritePointer(
+            getChannelIndexInProcessBlockBuffer(false, 1 + p, c), startSample);
+      }
+    }
   }
+  resampler.process(outputs, numSamples);
+  profiler.lap(EngineProfiler::resample);
 }
 
 //==============================================================================
@@ -656,10 +1266,301 @@ juce::AudioProcessorEditor *GS1_juceAudioProcessor::createEditor() {
 }
 
 //==============================================================================
-void GS1_juceAudioProcessor::getStateInformation(juce::MemoryBlock &destData) {}
+// GS1S state: the bank by path, the program and its edited version as the
+// raw PatchConsts of the bank format, the FM modes and the part setup. A few
+// hundred bytes, whatever the size of the bank. Version 2 added the
+// performance settings, version 3 the polyphony.
+static constexpr int stateMagic = 0x53315347; // "GS1S"
+static constexpr int stateVersion = 3;
+
+void GS1_juceAudioProcessor::getStateInformation(juce::MemoryBlock &destData) {
+  PatchConsts edited = bank->getPatch(currentProgram);
+  int modes[2];
+  patchParameters.read(edited, modes);
+
+  juce::MemoryOutputStream stream(destData, false);
+  stream.writeInt(stateMagic);
+  stream.writeInt(stateVersion);
+  stream.writeString(bank->getFile().getFullPathName());
+  stream.writeInt(currentProgram);
+  stream.write(&edited, sizeof(edited));
+  stream.writeInt(modes[0]);
+  stream.writeInt(modes[1]);
+  // Not from parts[], the audio thread owns those.
+  for (int p = 0; p < numParts; p++) {
+    stream.writeInt(partPatches[p]);
+    stream.writeInt(partVoiceLimits[p]);
+  }
+
+  PerformanceSettings performance;
+  patchParameters.read(performance);
+  stream.writeFloat(performance.bendRange);
+  stream.writeBool(performance.mpe);
+  stream.writeFloat(performance.mpeBendRange);
+  stream.writeFloat(performance.vibratoRate);
+  stream.writeFloat(performance.vibratoDepth);
+  stream.writeFloat(performance.modWheelDepth);
+  stream.writeFloat(performance.portamentoTime);
+  stream.writeInt(requestedPolyphony);
+}
 
 void GS1_juceAudioProcessor::setStateInformation(const void *data,
-                                                 int sizeInBytes) {}
+                                                 int sizeInBytes) {
+  juce::MemoryInputStream stream(data, (size_t)sizeInBytes, false);
+  if (stream.readInt() != stateMagic) {
+    return;
+  }
+  const int version = stream.readInt();
+  if (version < 1 || version > stateVersion) {
+    return;
+  }
+  const auto bankPath = stream.readString();
+  const int program = stream.readInt();
+  PatchConsts edited;
+  if (stream.read(&edited, sizeof(edited)) != (int)sizeof(edited)) {
+    return;
+  }
+  const int ch1Mode = stream.readInt();
+  const int ch2Mode = stream.readInt();
+
+  // A bank that moved or went away falls back to the factory one.
+  if (bankPath.isEmpty() || !loadBank(juce::File(bankPath))) {
+    useBank(PatchBank::getFactory());
+  }
+  setCurrentProgram(program);
+  patchParameters.load(edited);
+  setFMModes(ch1Mode, ch2Mode);
+
+  for (int p = 0; p < numParts && !stream.isExhausted(); p++) {
+    setPartPatch(p, stream.readInt());
+    setPartVoiceLimit(p, stream.readInt());
+  }
+
+  if (version >= 2) {
+    PerformanceSettings performance;
+    performance.bendRange = stream.readFloat();
+    performance.mpe = stream.readBool();
+    performance.mpeBendRange = stream.readFloat();
+    performance.vibratoRate = stream.readFloat();
+    performance.vibratoDepth = stream.readFloat();
+    performance.modWheelDepth = stream.readFloat();
+    performance.portamentoTime = stream.readFloat();
+    patchParameters.load(performance);
+    publishPatch();
+  }
+  // Applied by the next prepareToPlay().
+  if (version >= 3) {
+    setPolyphony(stream.readInt());
+  }
+}
+
+//==============================================================================
+// GS1E engine state: an EngineStateHeader, every voice with its note cache
+// pointer as a note number, the voice allocator, the runtime fields of the
+// parts, the controllers, then the chorus of each output and the resampler.
+// Raw and host endian, for the same build only.
+struct EngineStateHeader {
+  uint32_t magic;
+  uint32_t version;
+  uint64_t size;      // Of the whole state.
+  uint32_t voiceSize; // sizeof(VoiceState), catches layout changes.
+  int32_t numVoices, numParts, numOutputs;
+  int32_t cacheNotes, cacheSamples; // 0 without a note cache.
+  double sampleRate;
+};
+static constexpr uint32_t engineStateMagic = 0x45315347; // "GS1E"
+static constexpr uint32_t engineStateVersion = 1;
+
+static bool isModulatorOutput(int value) {
+  return value >= 0 && value <= 4095;
+}
+
+// A saved voice the engine can continue: indices in range, envelopes it
+// can run and no NaN in the pitch.
+static bool isRestorable(const VoiceState &voiceState, int numPatches) {
+  const VoiceState &v = voiceState;
+  return juce::isPositiveAndBelow(v.part, GS1_juceAudioProcessor::numParts) &&
+         juce::isPositiveAndBelow(v.channel,
+                                  GS1_juceAudioProcessor::numParts) &&
+         juce::isPositiveAndBelow(v.patch, numPatches) &&
+         v.envelopes.isValid() && isModulatorOutput(v.M1) &&
+         isModulatorOutput(v.M2) && isModulatorOutput(v.M1old1) &&
+         isModulatorOutput(v.M1old2) && isModulatorOutput(v.M2old1) &&
+         isModulatorOutput(v.M2old2) && std::isfinite(v.pitch) &&
+         std::isfinite(v.portamento) && std::isfinite(v.portamentoStep);
+}
+
+void GS1_juceAudioProcessor::writeEngineState(StateWriter &writer,
+                                              size_t size) const {
+  EngineStateHeader header = {};
+  header.magic = engineStateMagic;
+  header.version = engineStateVersion;
+  header.size = size;
+  header.voiceSize = sizeof(VoiceState);
+  header.numVoices = numVoices;
+  header.numParts = numParts;
+  header.numOutputs = numOutputs;
+  if (noteCache != nullptr) {
+    header.cacheNotes = noteCache->getNumNotes();
+    header.cacheSamples = noteCache->getNumSamples();
+  }
+  header.sampleRate = getSampleRate();
+  writer.write(header);
+
+  for (const auto &voiceState : voiceStates) {
+    VoiceState saved = voiceState;
+    saved.cached = nullptr;
+    writer.write(saved);
+    const int32_t cached = voiceState.cached != nullptr
+                               ? noteCache->indexOf(voiceState.cached)
+                               : -1;
+    writer.write(cached);
+  }
+  voices.saveState(writer);
+  for (const auto &part : parts) {
+    writer.write(part.patch);
+    writer.write(part.numVoices);
+    writer.write(part.sustainPedal);
+    writer.write(part.lastNote);
+  }
+  writer.write(noteCounter);
+  writer.write(gliding);
+  writer.write(pitchWheels);
+  writer.write(modWheels);
+  writer.write(channelPitch);
+  writer.write(channelVibrato);
+  writer.write(vibratoPhase);
+  writer.write(silentSamples);
+  for (int o = 0; o < numOutputs; o++) {
+    choruses[o].saveState(writer);
+  }
+  resampler.saveState(writer);
+}
+
+size_t GS1_juceAudioProcessor::getEngineStateSize() const {
+  StateWriter counter(nullptr, 0);
+  writeEngineState(counter, 0);
+  return counter.getSize();
+}
+
+bool GS1_juceAudioProcessor::saveEngineState(void *dest,
+                                             size_t capacity) const {
+  const size_t size = getEngineStateSize();
+  if (capacity < size) {
+    return false;
+  }
+  StateWriter writer(dest, capacity);
+  writeEngineState(writer, size);
+  return writer.isComplete();
+}
+
+bool GS1_juceAudioProcessor::restoreEngineState(const void *data,
+                                                size_t size) {
+  StateReader reader(data, size);
+  EngineStateHeader header;
+  if (!reader.read(header) || header.magic != engineStateMagic ||
+      header.version != engineStateVersion || header.size != size ||
+      header.voiceSize != sizeof(VoiceState) ||
+      header.numVoices != numVoices || header.numParts != numParts ||
+      header.numOutputs != numOutputs ||
+      header.sampleRate != getSampleRate() ||
+      size != getEngineStateSize()) {
+    return false;
+  }
+  const int cacheNotes = noteCache != nullptr ? noteCache->getNumNotes() : 0;
+  const int cacheSamples =
+      noteCache != nullptr ? noteCache->getNumSamples() : 0;
+  if (header.cacheNotes != cacheNotes ||
+      header.cacheSamples != cacheSamples) {
+    return false;
+  }
+
+  // Everything is read into spares and locals and checked first, the
+  // engine only changes once the whole snapshot is known to be good.
+  const int numPatches =
+      snapshot != nullptr ? snapshot->bank->getNumPatches() : INT_MAX;
+  for (auto &voiceState : restoredVoiceStates) {
+    int32_t cached = -1;
+    if (!reader.read(voiceState) || !reader.read(cached) ||
+        !isRestorable(voiceState, numPatches) || cached < -1 ||
+        cached >= cacheNotes ||
+        (cached >= 0 && !juce::isPositiveAndNotGreaterThan(
+                            voiceState.cachePosition, cacheSamples))) {
+      return false;
+    }
+    voiceState.cached = cached >= 0 ? noteCache->getNote(cached) : nullptr;
+  }
+  if (!restoredVoices.loadState(reader)) {
+    return false;
+  }
+  int partVoices[numParts] = {};
+  for (int v = 0; v < numVoices; v++) {
+    if (restoredVoices.getList(v) != VoiceAllocator::freeList) {
+      partVoices[restoredVoiceStates[(size_t)v].part]++;
+    }
+  }
+
+  Part restoredParts[numParts];
+  for (int p = 0; p < numParts; p++) {
+    Part &part = restoredParts[p];
+    if (!reader.read(part.patch) || !reader.read(part.numVoices) ||
+        !reader.read(part.sustainPedal) || !reader.read(part.lastNote) ||
+        !juce::isPositiveAndBelow(part.patch, numPatches) ||
+        part.numVoices != partVoices[p] || part.lastNote < -1 ||
+        part.lastNote > 127) {
+      return false;
+    }
+  }
+  uint32_t restoredCounter = 0;
+  bool restoredGliding = false;
+  float wheels[4][numParts];
+  double restoredPhase = 0;
+  int restoredSilence = 0;
+  if (!reader.read(restoredCounter) || !reader.read(restoredGliding) ||
+      !reader.read(wheels[0]) || !reader.read(wheels[1]) ||
+      !reader.read(wheels[2]) || !reader.read(wheels[3]) ||
+      !reader.read(restoredPhase) || !reader.read(restoredSilence) ||
+      !std::all_of(&wheels[0][0], &wheels[0][0] + 4 * numParts,
+                   [](float x) { return std::isfinite(x); }) ||
+      !std::isfinite(restoredPhase) || restoredSilence < 0) {
+    return false;
+  }
+  const size_t effectsPosition = reader.getPosition();
+  for (int o = 0; o < numOutputs; o++) {
+    if (!choruses[o].checkState(reader)) {
+      return false;
+    }
+  }
+  if (!resampler.checkState(reader) || reader.getPosition() != size) {
+    return false;
+  }
+
+  std::swap(voiceStates, restoredVoiceStates);
+  std::swap(voices, restoredVoices);
+  for (int p = 0; p < numParts; p++) {
+    parts[p].patch = restoredParts[p].patch;
+    parts[p].numVoices = restoredParts[p].numVoices;
+    parts[p].sustainPedal = restoredParts[p].sustainPedal;
+    parts[p].lastNote = restoredParts[p].lastNote;
+    partPatches[p] = parts[p].patch;
+  }
+  noteCounter = restoredCounter;
+  gliding = restoredGliding;
+  std::copy_n(wheels[0], numParts, pitchWheels);
+  std::copy_n(wheels[1], numParts, modWheels);
+  std::copy_n(wheels[2], numParts, channelPitch);
+  std::copy_n(wheels[3], numParts, channelVibrato);
+  vibratoPhase = restoredPhase;
+  silentSamples = restoredSilence;
+  StateReader effects(static_cast<const uint8_t *>(data) + effectsPosition,
+                      size - effectsPosition);
+  for (int o = 0; o < numOutputs; o++) {
+    choruses[o].loadState(effects);
+  }
+  resampler.loadState(effects);
+  outputSilent = false;
+  return true;
+}
 
 //==============================================================================
 // This creates new instances of the plugin..
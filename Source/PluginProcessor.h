@@ -8,79 +8,93 @@
 
 #pragma once
 
+#include "Chorus.h"
+#include "DisplayFeed.h"
+#include "EngineProfiler.h"
+#include "EngineState.h"
+#include "Envelope.h"
+#include "FMKernels.h"
+#include "NoteCache.h"
+#include "Patch.h"
+#include "PatchBank.h"
+#include "Resampler.h"
+#include "TripleBuffer.h"
+#include "VoiceAllocator.h"
+#include "WorkerPool.h"
 #include <JuceHeader.h>
 
-struct VoiceState {
-  float NOTE = 0;
-  int GATE = 0;
-  int GATEOLD = 0;
-  int GATENEW = 0;
-  int Mode = 0;                           // 0=Norm 1=Perc (ENVELOPE MODE)
+// Cache line aligned, so render threads storing neighbouring voices never
+// write to the same line.
+struct alignas(64) VoiceState {
+  int GATE = 0; // Key down or held by the sustain pedal.
   float AT[4] = {2000, 2000, 4400, 4400}; //(Original envelope setting)
   float DT[4] = {2, 2, 1, 1};
   float RT[4] = {100, 100, 100, 100};
-  int STATE[4] = {0, 0, 0, 0};
-  float EA[4] = {0, 0, 0, 0};  // 16bit
-  float EAx[4] = {0, 0, 0, 0}; // 16bit
-  float EAo[4] = {0, 0, 0, 0}; // oldaccu
-  float RS[4] = {0, 0, 0, 0};
-  float RSx[4] = {0, 0, 0, 0};
-  int PAI[4];
-  int PAE[4];
-  int CW[4] = {0, 0, 0, 0};        // C1,C2,M1,M2
+  OperatorEnvelopes envelopes;
+  int PAI[4] = {0, 0, 0, 0};
+  int PAE[4] = {0, 0, 0, 0};
+  int CW[4] = {0, 0, 0, 0};        // C1,C2,M1,M2, keyCW at the pitch.
+  int keyCW[4] = {0, 0, 0, 0};     // Of the key, before pitch modulation.
+  int targetCW[4] = {0, 0, 0, 0};  // keyCW glides here after a patch edit.
   int AMP[4] = {255, 0, 255, 255}; // C1,C2,M1,M2
   int CH1 = 0;
   int CH2 = 0;
   int M1 = 0;
   int M2 = 0;
-  int M1old1, M1old2 = 0;
-  int M2old1, M2old2 = 0;
+  int M1old1 = 0, M1old2 = 0;
+  int M2old1 = 0, M2old2 = 0;
   int EG0 = 0;
   int EG1 = 0;
   int EG2 = 0;
   int EG3 = 0;
-  float rnd = 0;
-  float KNOTE;
-  float Velocity;
+  float KNOTE = 0;
+  float Velocity = 0;
 
-  int midiNote;
-  bool noteOn;
-  bool sustaining = false;
+  int midiNote = -1;
+  bool noteOn = false;
+  int part = 0;             // Part (MIDI channel) that played the note.
+  int channel = 0;          // MIDI channel - 1, differs from part with MPE.
+  int patch = 0;
+  float pitch = 0;          // Semitones CW is off the key.
+  float portamento = 0;     // Semitones still to glide, towards 0.
+  float portamentoStep = 0; // Per engine sample.
+  uint32_t noteIndex = 0;   // Order of the note ons, for stealing.
+
+  // Set while the voice plays from the note cache instead of the engine.
+  // Only CW and the note fields above are kept up, the rest is at the
+  // note on until the voice continues live.
+  const CachedNote *cached = nullptr;
+  int cachePosition = 0; // Engine samples played from it.
+};
+
+// Kernel scratch for one slice of the active voices. With render threads
+// every slice is rendered by its own job into its own sums.
+struct VoiceGroup {
+  FMLanes lanes;
+  FMAmpBlock amps;
+  std::vector<int32_t> sums; // CH1 + CH2 of the slice, per engine sample.
+  std::vector<int32_t> batchSums; // Lanes past the first FMLanes::maxLanes.
 };
 
-struct PatchConsts {
-  float Ratio[4] = {1, 1, 1, 1};  // C1,C2,M1,M2 Ratios.
-  int Detune[4] = {0, 12, 3, 12}; // C1,C2,M1,M2 detune in cents +-16
-
-  // 44(2key) settings. (First two values in array set upper and lower scaling
-  // to the rest of values.)
-  float C1EC[46] = {0.0, 0.65, 0.9, 0.9, 0.9, 0.9, 0.9, 0.9, 0.9, 0.9, 0.9, 0.9,
-                    0.9, 0.9,  0.9, 1,   1,   1,   1,   1,   1,   1,   1,   1,
-                    1,   1,    1,   1,   1,   1,   1,   1,   1,   1,   1,   1,
-                    0.9, 0.9,  0.8, 0.8, 0.8, 0.8, 0.8, 0.8, 0.8, 0.8};
-  float C2EC[46] = {0.0, 0.35, 0.2, 0.3, 0.3, 0.4, 0.5, 0.5, 0.6, 0.6, 0.7, 0.7,
-                    0.8, 0.8,  0.9, 0.9, 1,   1,   1,   1,   0.9, 0.9, 0.8, 0.7,
-                    0.6, 0.5,  0.4, 0.3, 0.2, 0.2, 0.1, 0.1, 0.1, 0.1, 0.1, 0.1,
-                    0.1, 0.1,  0.1, 0.1, 0.1, 0.1, 0.1, 0.1, 0.1, 0.1};
-  float M1EC[46] = {0.0,  0.7,  0.9,  0.9,  0.6,  0.6, 0.6, 0.6, 0.7, 0.7,
-                    0.7,  0.8,  0.8,  0.9,  0.9,  1,   0.9, 0.8, 0.8, 0.7,
-                    0.7,  0.7,  0.7,  0.6,  0.6,  0.5, 0.5, 0.4, 0.4, 0.3,
-                    0.3,  0.2,  0.2,  0.1,  0.1,  0.1, 0.1, 0.1, 0.1, 0.1,
-                    0.05, 0.05, 0.05, 0.05, 0.05, 0.05};
-  float M2EC[46] = {0.1, 0.55, 0.9, 0.9, 1,   1,    1,    1,   1,   1,
-                    1,   1,    1,   0.9, 0.9, 0.8,  0.8,  0.7, 0.7, 0.7,
-                    0.6, 0.6,  0.6, 0.5, 0.5, 0.5,  0.5,  0.5, 0.5, 0.4,
-                    0.3, 0.2,  0.1, 0.1, 0.1, 0.05, 0.01, 0.0, 0.0, 0.0,
-                    0.0, 0.0,  0.0, 0.0, 0.0, 0.0};
-  
-  float ATE[4] = {2000, 2000, 4400, 4400}; // Scaled to key in perc mode
-  float DTE1Scaling = 3;
+// One MIDI channel of the multi-timbral engine.
+struct Part {
+  int patch = 0;
+  int maxVoices = 1 << 16; // Voice partition: notes past it steal within
+                           // the part. None by default.
+  int numVoices = 0;  // Sounding voices of the part.
+  bool sustainPedal = false;
+  int output = 0;    // Engine mix the part renders into, 0 is the main
+                     // output.
+  int lastNote = -1; // Portamento starts here.
 };
 
 //==============================================================================
 /**
  */
-class GS1_juceAudioProcessor : public juce::AudioProcessor {
+class GS1_juceAudioProcessor
+    : public juce::AudioProcessor,
+      private juce::AudioProcessorValueTreeState::Listener,
+      private juce::Timer {
 public:
   //==============================================================================
   GS1_juceAudioProcessor();
@@ -119,23 +133,184 @@ public:
 
   //==============================================================================
 
-  VoiceState voiceStates[32];
-  int lastVoice = 0;
-  int chorusPos = 0;
+  static constexpr int minPolyphony = 8;
+  static constexpr int maxPolyphony = 1024;
+  static constexpr int defaultPolyphony = 32;
+  static constexpr int numParts = 16; // One per MIDI channel.
+
+  // Voices of the engine from the next prepareToPlay() on, which allocates
+  // them and stops every note if the number changed. Any thread.
+  void setPolyphony(int numVoices);
+  int getPolyphony() const { return numVoices; }
+
+  // The voice pool, one block allocated by prepareToPlay() and never on the
+  // audio thread.
+  int numVoices = 0;
+  std::vector<VoiceState> voiceStates;
+  VoiceAllocator voices;
+  uint32_t noteCounter = 0;
+  // Where restoreEngineState() checks the voices before swapping them in.
+  std::vector<VoiceState> restoredVoiceStates;
+  VoiceAllocator restoredVoices;
+
+  // Parts with their own output bus render and chorus separately, the others
+  // share the main mix. Set up by prepareToPlay() from the bus layout.
+  Part parts[numParts];
+  int numOutputs = 1;
+  std::vector<int> outputVoices; // Active voices per output, numVoices each.
+  int numOutputVoices[1 + numParts];
+
+  Chorus choruses[1 + numParts]; // Per output.
 
-  juce::dsp::DelayLine<float, juce::dsp::DelayLineInterpolationTypes::Linear>
-      delayA;
-  juce::dsp::DelayLine<float, juce::dsp::DelayLineInterpolationTypes::Linear>
-      delayB;
-  juce::dsp::DelayLine<float, juce::dsp::DelayLineInterpolationTypes::Linear>
-      delayC;
+  // Active voices laid out one per lane for the FM kernel.
+  FMKernel kernel;
+  FMKernelIsa kernelIsa = FMKernelIsa::scalar;
+  FMLookup kernelLookup = FMLookup::twoStage;
+  std::vector<VoiceGroup> voiceGroups; // One per render thread, plus one.
+  std::unique_ptr<WorkerPool> workers;
 
-  int currentPatch = 0;
-  PatchConsts patches[2];
+  Resampler resampler;
+  EngineProfiler profiler; // Read from any one thread.
+  DisplayFeed display;     // Read by the editor.
+  juce::AudioBuffer<float> engineBuffer; // Voice mix per output, engine rate.
+  int maxBlockSize = 0;
 
-  void noteOn(VoiceState &voiceState, float KNOTE, float Velocity);
+  // Programs come from the bank. The parameters edit the current program on
+  // top of its bank version.
+  juce::AudioProcessorValueTreeState parameters;
+  PatchParameters patchParameters;
+
+  // Rebuilds the patch snapshot from the bank and the parameters and hands
+  // it to the audio thread. Message thread, edits are picked up by a
+  // timer.
+  void publishPatch();
+
+  // Audio thread view of the patches, switched at block boundaries.
+  const PatchSnapshot *snapshot = nullptr;
+  int fmModes[2] = {0, 0}; // FM mode CH1 and CH2
+
+  // Swaps in a bank file, false if it is not a valid bank. Message thread.
+  bool loadBank(const juce::File &file);
+
+  void noteOn(VoiceState &voiceState, int patch, float KNOTE, float Velocity);
   int fmGenSample(VoiceState &voiceState);
 
+  // FM routing for CH1 and CH2: 0=NORM 1=PI/2 2=PI 3=CROSS. Sets the
+  // parameters, the audio thread switches on its next block.
+  void setFMModes(int ch1Mode, int ch2Mode);
+
+  // Picks the FM kernel variant. The constructor selects the widest one the
+  // CPU supports, the scalar one is always available.
+  void setKernelIsa(FMKernelIsa isa);
+  // Operator lookup of the kernel, two-stage by default. The output is the
+  // same with all of them, only the speed differs.
+  void setKernelLookup(FMLookup lookup);
+
+  // Patch and voice partition of a part. setCurrentProgram() sets the patch
+  // of every part, a program change sets the one of its channel. Any thread,
+  // the audio thread switches on its next block.
+  void setPartPatch(int part, int patch);
+  void setPartVoiceLimit(int part, int maxVoices);
+
+  // Extra realtime threads that render slices of the active voices in
+  // parallel, 0 renders everything on the audio thread. The output is
+  // bit-identical either way. Call while not processing.
+  void setRenderThreads(int numThreads);
+
+  // Plays held notes from pre-rendered audio where it can, see NoteCache.
+  // Caches the patches of settings, or those the parts play now. Loads the
+  // cache saved next to the bank file if it was made from the same patches,
+  // edits and FM routing, otherwise renders one on all cores and saves it
+  // there. Takes seconds. Unbent notes play from the cache until they are
+  // released, then continue live. Call while not processing; false if
+  // nothing could be cached or it would take more than settings.maxBytes.
+  bool enableNoteCache(const NoteCacheSettings &settings);
+  void disableNoteCache();
+  const NoteCache *getNoteCache() const { return noteCache.get(); }
+
+  // True after a block that skipped all processing and cleared the buffer:
+  // no voices, no MIDI, and chorus and resampler had run dry.
+  bool isOutputSilent() const { return outputSilent; }
+
+  // Snapshot of the running engine: voices, voice allocation, controllers,
+  // chorus and resampler, everything the next block continues from, but
+  // not the patches and parameters (see getStateInformation()). A fixed
+  // size once prepared, copied raw without allocating. Call between blocks,
+  // on the audio thread or while not processing. Restoring needs an engine
+  // prepared the same way, with the same sample rate, outputs and note
+  // cache, and a snapshot it can continue from; it returns false and
+  // changes nothing otherwise, also for a damaged one.
+  size_t getEngineStateSize() const;
+  bool saveEngineState(void *dest, size_t capacity) const;
+  bool restoreEngineState(const void *data, size_t size);
+
+private:
+  void parameterChanged(const juce::String &parameterID,
+                        float newValue) override;
+  void timerCallback() override;
+  void applyPatch();
+  const PatchConsts &getPatchData(int patch) const;
+  const KeyParams &getKeyParams(int patch, int note) const;
+  void useBank(std::shared_ptr<const PatchBank> newBank);
+  void glideControlWords(int numSamples);
+  void allocateVoices(int polyphony);
+
+  TripleBuffer<PatchSnapshot> patchSnapshots;
+  juce::CriticalSection publishLock; // Between writers only.
+  std::atomic<bool> patchEdited{false};
+  std::shared_ptr<const PatchBank> bank; // Message thread.
+  std::shared_ptr<const std::vector<KeyParams>> bankKeys; // Of bank.
+  double bankReleaseSeconds = 0;         // Slowest release in the bank.
+  std::atomic<double> tailSeconds{0};
+  std::atomic<int> currentProgram{0};
+  std::atomic<int> pendingPatches[numParts]; // -1 or the next patch.
+  std::atomic<int> partVoiceLimits[numParts]; // Taken every block.
+  std::atomic<int> partPatches[numParts];     // As last set, for the state.
+  std::atomic<int> requestedPolyphony{defaultPolyphony};
+  bool gliding = false;
+
+  // Pitch modulation. Wheels per MIDI channel, the pitch and vibrato depth
+  // they give in semitones, and the vibrato LFO at each kernel chunk of the
+  // current render.
+  float pitchWheels[numParts] = {}; // -1 to 1
+  float modWheels[numParts] = {};   // 0 to 1
+  float channelPitch[numParts] = {};
+  float channelVibrato[numParts] = {};
+  std::vector<float> vibratoLfo;
+  double vibratoPhase = 0; // Cycles.
+
+  int silentSamples = 0; // Engine samples since a voice last sounded.
+  int drainSamples = 0;  // Silence that empties the chorus and resampler.
+  std::atomic<bool> outputSilent{false};
+
+  std::shared_ptr<const NoteCache> noteCache;
+  std::vector<int32_t> cacheSums; // Cached voices, per engine sample.
+  std::vector<int> liveVoices;    // Scratch of renderVoiceList().
+  void leaveCache(VoiceState &voiceState);
+  void leaveCacheIfModulated(int numSamples);
+
+  void loadLanes(VoiceGroup &group, const int *voices, int count);
+  void storeLanes(const VoiceGroup &group, const int *voices, int count);
+  void renderVoiceGroup(VoiceGroup &group, const int *voices, int count,
+                        int numSamples);
+  void modulatePitch(FMLanes &lanes, const int *voices, int count, int chunk,
+                     int numSamples);
+  void updatePitchControls(int numSamples);
+  int allocateVoice(int part, int channel, int note);
+  int stealVoice(int part);
+  void releaseVoice(int voice);
+  void freeVoice(int voice);
+  void releaseFinishedVoices();
+  void handleMidiEvent(const juce::MidiMessage &message);
+  void renderVoiceList(const int *voices, int count, float *mix,
+                       int startSample, int endSample);
+  void renderVoices(int startSample, int endSample);
+  void renderBlock(juce::AudioBuffer<float> &buffer,
+                   juce::MidiBuffer &midiMessages, int startSample,
+                   int numSamples);
+  void publishDisplay(const juce::AudioBuffer<float> &buffer);
+  void writeEngineState(StateWriter &writer, size_t size) const;
+
 private:
   //==============================================================================
   JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(GS1_juceAudioProcessor)
@@ -0,0 +1,149 @@
+/*
+  ==============================================================================
+
+    Polyphase windowed-sinc sample rate converter for arbitrary ratios.
+
+  ==============================================================================
+*/
+
+#include "Resampler.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+static constexpr double kaiserBeta = 8.0; // ~80dB stopband.
+static constexpr double passband = 0.92;  // Fraction of the lower Nyquist.
+static_assert(Resampler::numPhases == 256,
+              "process() takes the phase from the top 8 fraction bits");
+
+// Tap the output sample sits on at phase 0. Input sample k of a block is
+// written after numTaps of history, and read position p has the centre on
+// p + centreTap, so an input comes out numTaps - centreTap samples later.
+static constexpr int centreTap = Resampler::numTaps / 2 - 1;
+static constexpr int delaySamples = Resampler::numTaps - centreTap;
+
+static double besselI0(double x) {
+  double sum = 1.0, term = 1.0;
+  for (int k = 1; k < 32; k++) {
+    term *= (x / (2.0 * k)) * (x / (2.0 * k));
+    sum += term;
+  }
+  return sum;
+}
+
+void Resampler::prepare(double inputRate, double outputRate,
+                        int maxOutputBlock, int numChannels) {
+  bypass = inputRate == outputRate;
+  step = (uint64_t)std::llround(inputRate / outputRate * 4294967296.0);
+  maxInputBlock =
+      bypass ? maxOutputBlock
+             : (int)std::ceil(maxOutputBlock * inputRate / outputRate) + 2;
+  latency = bypass ? 0
+                   : (int)std::lround(delaySamples * outputRate / inputRate);
+
+  inputs.assign(numChannels,
+                std::vector<float>(numTaps + maxInputBlock + 1, 0.0f));
+  if (!bypass) {
+    buildKernel(passband * std::min(1.0, outputRate / inputRate));
+  }
+  reset();
+}
+
+void Resampler::reset() {
+  position = 0;
+  for (auto &channel : inputs) {
+    std::fill(channel.begin(), channel.end(), 0.0f);
+  }
+}
+
+void Resampler::buildKernel(double cutoff) {
+  kernel.assign((numPhases + 1) * numTaps, 0.0f);
+  const double half = numTaps / 2;
+  for (int phase = 0; phase <= numPhases; phase++) {
+    float *row = &kernel[phase * numTaps];
+    double sum = 0;
+    for (int j = 0; j < numTaps; j++) {
+      // Output sample sits between taps centreTap and centreTap + 1.
+      const double x = j - centreTap - (double)phase / numPhases;
+      const double arg = cutoff * x * 3.14159265358979323846;
+      const double sinc = x == 0 ? 1.0 : std::sin(arg) / arg;
+      const double u = x / half;
+      const double window =
+          std::abs(u) >= 1.0
+              ? 0.0
+              : besselI0(kaiserBeta * std::sqrt(1.0 - u * u)) /
+                    besselI0(kaiserBeta);
+      row[j] = (float)(cutoff * sinc * window);
+      sum += row[j];
+    }
+    // Unity gain at DC for every phase.
+    for (int j = 0; j < numTaps; j++) {
+      row[j] = (float)(row[j] / sum);
+    }
+  }
+}
+
+int Resampler::getInputIndex(int outputSample) const {
+  if (bypass) {
+    return outputSample;
+  }
+  return (int)((position + (uint64_t)outputSample * step) >> 32);
+}
+
+void Resampler::process(float *const *outputs, int numOutput) {
+  const int numChannels = (int)inputs.size();
+  if (bypass) {
+    for (int ch = 0; ch < numChannels; ch++) {
+      std::memcpy(outputs[ch], inputs[ch].data(), sizeof(float) * numOutput);
+    }
+    return;
+  }
+
+  const int consumed = getInputSamplesNeeded(numOutput);
+  for (int ch = 0; ch < numChannels; ch++) {
+    const float *in = inputs[ch].data();
+    float *out = outputs[ch];
+    uint64_t pos = position;
+    for (int i = 0; i < numOutput; i++, pos += step) {
+      const float *x = in + (pos >> 32);
+      // Top bits of the fraction pick the phase, the rest interpolate.
+      const uint32_t frac = (uint32_t)pos;
+      const int phase = (int)(frac >> 24);
+      const float t = (float)(frac & 0xFFFFFF) * (1.0f / 16777216.0f);
+      const float *a = &kernel[phase * numTaps];
+      const float *b = a + numTaps;
+      float sumA = 0, sumB = 0;
+      for (int j = 0; j < numTaps; j++) {
+        sumA += x[j] * a[j];
+        sumB += x[j] * b[j];
+      }
+      out[i] = sumA + t * (sumB - sumA);
+    }
+    // Keep the last numTaps inputs as history for the next block.
+    std::memmove(inputs[ch].data(), inputs[ch].data() + consumed,
+                 sizeof(float) * numTaps);
+  }
+  position = (position + (uint64_t)numOutput * step) & 0xFFFFFFFFull;
+}
+
+//==============================================================================
+void Resampler::saveState(StateWriter &writer) const {
+  writer.write(position);
+  for (const auto &input : inputs) {
+    writer.write(input.data(), numTaps);
+  }
+}
+
+bool Resampler::checkState(StateReader &reader) const {
+  uint64_t saved = 0;
+  return reader.read(saved) && saved <= 0xFFFFFFFFull &&
+         reader.skip<float>(inputs.size() * numTaps);
+}
+
+void Resampler::loadState(StateReader &reader) {
+  reader.read(position);
+  for (auto &input : inputs) {
+    reader.read(input.data(), numTaps);
+  }
+}
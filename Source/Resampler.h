@@ -0,0 +1,66 @@
+/*
+  ==============================================================================
+
+    Polyphase windowed-sinc sample rate converter for arbitrary ratios.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include "EngineState.h"
+#include <cstdint>
+#include <vector>
+
+// Converts blocks from inputRate to outputRate. The caller asks how many input
+// samples the next output block needs, writes them to getInputPointer(), then
+// calls process(). Positions are tracked in 32.32 fixed point, so long renders
+// never drift.
+class Resampler {
+public:
+  static constexpr int numTaps = 32;
+  static constexpr int numPhases = 256;
+
+  void prepare(double inputRate, double outputRate, int maxOutputBlock,
+               int numChannels);
+  void reset();
+
+  bool isBypassed() const { return bypass; }
+
+  // Input sample (relative to the next block) that lines up with the given
+  // output sample. getInputIndex(numOutput) is the input block length.
+  int getInputIndex(int outputSample) const;
+  int getInputSamplesNeeded(int numOutput) const {
+    return getInputIndex(numOutput);
+  }
+  int getMaxInputBlock() const { return maxInputBlock; }
+
+  float *getInputPointer(int channel) {
+    return inputs[channel].data() + (bypass ? 0 : numTaps);
+  }
+
+  void process(float *const *outputs, int numOutput);
+
+  int getLatencyInOutputSamples() const { return latency; }
+
+  // Read position and input history. The resampler must be prepared for
+  // the same rates and channels as the saved one. checkState() reads past a
+  // state and returns false if its position is not within one input sample.
+  void saveState(StateWriter &writer) const;
+  bool checkState(StateReader &reader) const;
+  void loadState(StateReader &reader);
+
+private:
+  void buildKernel(double cutoff);
+
+  bool bypass = true;
+  uint64_t step = 0;     // Input samples per output sample, 32.32.
+  uint64_t position = 0; // Fractional read position, < 1.0.
+  int maxInputBlock = 0;
+  int latency = 0;
+
+  // numTaps of history followed by the next input block, per channel.
+  std::vector<std::vector<float>> inputs;
+  // (numPhases + 1) rows of numTaps coefficients.
+  std::vector<float> kernel;
+};
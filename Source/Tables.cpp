@@ -0,0 +1,94 @@
+/*
+  ==============================================================================
+
+    GS1 operator tables: log-sine and exponent, shared by the scalar voice
+    code and the FM kernels.
+
+  ==============================================================================
+*/
+
+#include "Tables.h"
+
+// Generated with (PI = 3.1415927):
+//   logsinTable[i] = round(-log2(sin(ceil(i + 0.5) * PI / 256 / 2)) * 256)
+//   expTable[i] = round((2^(i / 256) - 1) * 32768)
+// Kept as literals so they are built at compile time, live in read-only
+// memory and are shared by every instance.
+
+alignas(64) constexpr int logsinTable[256] = {
+    1881, 1625, 1475, 1369, 1287, 1220, 1163, 1113, 1070, 1031, 996, 964, 934,
+    907, 882, 858, 835, 814, 795, 776, 758, 741, 724, 709, 694, 679, 666, 652,
+    640, 627, 615, 604, 592, 582, 571, 561, 551, 541, 532, 523, 514, 505, 496,
+    488, 480, 472, 464, 457, 449, 442, 435, 428, 421, 415, 408, 402, 396, 389,
+    383, 377, 372, 366, 360, 355, 349, 344, 339, 334, 329, 324, 319, 314, 309,
+    304, 300, 295, 291, 286, 282, 278, 274, 269, 265, 261, 257, 253, 250, 246,
+    242, 238, 235, 231, 227, 224, 220, 217, 214, 210, 207, 204, 201, 198, 194,
+    191, 188, 185, 182, 179, 177, 174, 171, 168, 165, 163, 160, 157, 155, 152,
+    150, 147, 145, 142, 140, 137, 135, 133, 130, 128, 126, 124, 121, 119, 117,
+    115, 113, 111, 109, 107, 105, 103, 101, 99, 97, 95, 93, 91, 90, 88, 86, 84,
+    83, 81, 79, 78, 76, 74, 73, 71, 70, 68, 67, 65, 64, 62, 61, 59, 58, 57, 55,
+    54, 53, 51, 50, 49, 48, 46, 45, 44, 43, 42, 41, 39, 38, 37, 36, 35, 34, 33,
+    32, 31, 30, 29, 28, 27, 26, 26, 25, 24, 23, 22, 21, 21, 20, 19, 18, 18, 17,
+    16, 16, 15, 14, 14, 13, 12, 12, 11, 11, 10, 10, 9, 9, 8, 8, 7, 7, 6, 6, 5,
+    5, 5, 4, 4, 4, 3, 3, 3, 3, 2, 2, 2, 2, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0, 0,
+    0, 0, 0,
+};
+
+alignas(64) constexpr int expTable[256] = {
+    0, 89, 178, 267, 357, 447, 537, 627, 718, 808, 899, 991, 1082, 1174, 1266,
+    1358, 1451, 1544, 1637, 1730, 1823, 1917, 2011, 2106, 2200, 2295, 2390,
+    2485, 2581, 2677, 2773, 2869, 2966, 3063, 3160, 3257, 3355, 3453, 3551,
+    3649, 3748, 3847, 3947, 4046, 4146, 4246, 4346, 4447, 4548, 4649, 4750,
+    4852, 4954, 5056, 5159, 5262, 5365, 5468, 5572, 5676, 5780, 5885, 5989,
+    6095, 6200, 6306, 6412, 6518, 6624, 6731, 6838, 6946, 7053, 7161, 7269,
+    7378, 7487, 7596, 7705, 7815, 7925, 8036, 8146, 8257, 8368, 8480, 8592,
+    8704, 8816, 8929, 9042, 9155, 9269, 9383, 9497, 9612, 9727, 9842, 9958,
+    10073, 10190, 10306, 10423, 10540, 10657, 10775, 10893, 11012, 11130, 11249,
+    11369, 11488, 11608, 11729, 11849, 11970, 12091, 12213, 12335, 12457, 12580,
+    12703, 12826, 12950, 13074, 13198, 13323, 13448, 13573, 13699, 13825, 13951,
+    14078, 14205, 14332, 14460, 14588, 14716, 14845, 14974, 15103, 15233, 15363,
+    15494, 15625, 15756, 15887, 16019, 16152, 16284, 16417, 16551, 16684, 16818,
+    16953, 17088, 17223, 17358, 17494, 17631, 17767, 17904, 18042, 18179, 18317,
+    18456, 18595, 18734, 18874, 19014, 19154, 19295, 19436, 19578, 19720, 19862,
+    20005, 20148, 20291, 20435, 20579, 20724, 20869, 21014, 21160, 21306, 21453,
+    21600, 21747, 21895, 22043, 22192, 22341, 22490, 22640, 22790, 22941, 23092,
+    23244, 23395, 23548, 23700, 23854, 24007, 24161, 24315, 24470, 24625, 24781,
+    24937, 25093, 25250, 25408, 25565, 25723, 25882, 26041, 26200, 26360, 26521,
+    26681, 26843, 27004, 27166, 27329, 27492, 27655, 27819, 27983, 28148, 28313,
+    28479, 28645, 28811, 28978, 29146, 29313, 29482, 29651, 29820, 29989, 30160,
+    30330, 30501, 30673, 30845, 31017, 31190, 31364, 31538, 31712, 31887, 32062,
+    32238, 32414, 32591,
+};
+
+static_assert(logsinTable[0] + 4095 == FusedTables::maxAttenuation);
+
+FusedTables fusedTables;
+
+void buildFusedTables() {
+  static const bool built = [] {
+    auto &tables = fusedTables;
+    for (int a = 0; a <= FusedTables::maxAttenuation; a++) {
+      tables.exp[a] = (int16_t)lookupExp(a);
+    }
+    for (int fine = 0; fine < 256; fine++) {
+      for (int i = 0; i < 256; i++) {
+        tables.quarter[fine][i] = (int16_t)lookupExp(logsinTable[i] + fine);
+      }
+    }
+    for (int a = 0; a <= FusedTables::silentAttenuation; a++) {
+      for (int i = 0; i < 256; i++) {
+        tables.full[a][i] = (int16_t)lookupExp(logsinTable[i] + a);
+      }
+    }
+    return true;
+  }();
+  (void)built;
+}
+
+const std::array<double, 1201> pitchRatioTable = [] {
+  std::array<double, 1201> ratios;
+  for (int cents = 0; cents <= 1200; cents++) {
+    ratios[cents] = std::exp2(cents / 1200.0);
+  }
+  return ratios;
+}();
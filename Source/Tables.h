@@ -0,0 +1,85 @@
+/*
+  ==============================================================================
+
+    GS1 operator tables: log-sine and exponent, shared by the scalar voice
+    code and the FM kernels.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+
+// Note! Sinewave phase resolution has to be 10bit for quantization error to
+// give right sound!
+extern const int logsinTable[256];
+extern const int expTable[256];
+
+// 10bit phase -> attenuation (log domain), bit 15 carries the sign.
+inline int lookupSin(int val) {
+  bool signsin = (bool)(val & 512);
+  bool mirrorsin = (bool)(val & 256);
+  val &= 255;
+  int result = logsinTable[mirrorsin ? val ^ 255 : val ^ 0];
+  if (signsin) {
+    result |= 0x8000;
+  }
+  return result;
+}
+
+// Attenuation -> signed 14bit linear output.
+inline int lookupExp(int val) {
+  bool signexp = (bool)(val & 0x8000);
+  int t = (expTable[(val & 255) ^ 255] | (32768)) << 1;
+  int result = t >> ((val & 0x7F00) >> 8);
+  if (signexp) {
+    result = -result - 1;
+  }
+  return result >> 4;
+}
+
+//==============================================================================
+// lookupExp(lookupSin(phase) + amp) precomputed for amp 0-4095 over the
+// quarter wave, the sign and the mirror stay bit operations. Filled once by
+// buildFusedTables() and shared by every instance.
+struct FusedTables {
+  // lookupExp() is 0 from here on (-1 with the sign bit).
+  static constexpr int silentAttenuation = 13 << 8;
+  static constexpr int maxAttenuation = 1881 + 4095; // logsinTable[0] + amp
+
+  // Attenuation -> output, 12 kB. Fits L1 next to the sine table.
+  alignas(64) int16_t exp[maxAttenuation + 1];
+  // [amp & 255][quarter phase] -> output, 128 kB. The rest of the
+  // attenuation only shifts the mantissa, so amp >> 8 is a right shift.
+  alignas(64) int16_t quarter[256][256];
+  // [amp][quarter phase] -> output, 1.7 MB, amp clamped to
+  // silentAttenuation.
+  alignas(64) int16_t full[silentAttenuation + 1][256];
+  int16_t padding[2]; // 32bit gathers read past the last entry.
+};
+
+extern FusedTables fusedTables;
+
+// Thread safe, cheap after the first call.
+void buildFusedTables();
+
+//==============================================================================
+// 2^(cents / 1200) for 0-1200 cents, built at startup. Pitch modulation
+// scales control words through this instead of calling pow().
+extern const std::array<double, 1201> pitchRatioTable;
+
+// 2^(semitones / 12): whole octaves are an exponent, the rest interpolates
+// between two cents.
+inline double getPitchRatio(float semitones) {
+  const float octaves = std::floor(semitones * (1.0f / 12));
+  const float cents = (semitones - octaves * 12) * 100;
+  const int index = std::min((int)cents, 1199);
+  const double low = pitchRatioTable[index];
+  const double ratio =
+      low + (pitchRatioTable[index + 1] - low) * (cents - (float)index);
+  return std::ldexp(ratio, (int)octaves);
+}
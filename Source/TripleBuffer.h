@@ -0,0 +1,46 @@
+/*
+  ==============================================================================
+
+    Wait-free single writer / single reader hand-over of a whole object.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <atomic>
+
+// The writer fills getWriteBuffer() and publishes it, the reader calls
+// acquire() and then reads read() until its next acquire(). Neither side
+// ever waits for the other: they swap slot indices through one atomic, so
+// the reader always sees a complete object and can hold on to it for as
+// long as it likes.
+template <class T> class TripleBuffer {
+public:
+  T &getWriteBuffer() { return slots[back]; }
+
+  void publish() {
+    back = middle.exchange(back | newBit, std::memory_order_acq_rel) & slotMask;
+  }
+
+  // Switches to the latest published object, false if there was none since
+  // the last call.
+  bool acquire() {
+    if ((middle.load(std::memory_order_relaxed) & newBit) == 0) {
+      return false;
+    }
+    front = middle.exchange(front, std::memory_order_acq_rel) & slotMask;
+    return true;
+  }
+
+  const T &read() const { return slots[front]; }
+
+private:
+  static constexpr int slotMask = 3;
+  static constexpr int newBit = 4;
+
+  T slots[3];
+  int front = 0; // Reader only.
+  std::atomic<int> middle{1};
+  int back = 2; // Writer only.
+};
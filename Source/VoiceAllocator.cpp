@@ -0,0 +1,166 @@
+/*
+  ==============================================================================
+
+    Voice bookkeeping: which voices are free, held, sustained or releasing,
+    and which voice plays a given note.
+
+  ==============================================================================
+*/
+
+#include "VoiceAllocator.h"
+#include <algorithm>
+
+void VoiceAllocator::setSize(int numVoices, int numParts) {
+  const int numLists = firstSustainedList + numParts;
+  heads.assign(numLists, -1);
+  tails.assign(numLists, -1);
+  prev.assign(numVoices, -1);
+  next.assign(numVoices, -1);
+  voiceList.assign(numVoices, freeList);
+  active.assign(numVoices, -1);
+  activeSlot.assign(numVoices, -1);
+  notes.assign(numParts * 128, -1);
+  voiceNote.assign(numVoices, -1);
+  numActive = 0;
+  numFree = 0;
+
+  // Hand out voice 0 first.
+  for (int v = 0; v < numVoices; v++) {
+    voiceList[v] = -1;
+    moveTo(v, freeList);
+  }
+}
+
+void VoiceAllocator::unlink(int voice) {
+  const int list = voiceList[voice];
+  (prev[voice] >= 0 ? next[prev[voice]] : heads[list]) = next[voice];
+  (next[voice] >= 0 ? prev[next[voice]] : tails[list]) = prev[voice];
+  if (list == freeList) {
+    numFree--;
+  }
+}
+
+void VoiceAllocator::moveTo(int voice, int list) {
+  if (voiceList[voice] >= 0) {
+    unlink(voice);
+  }
+
+  prev[voice] = tails[list];
+  next[voice] = -1;
+  (tails[list] >= 0 ? next[tails[list]] : heads[list]) = voice;
+  tails[list] = voice;
+  voiceList[voice] = list;
+
+  if (list == freeList) {
+    numFree++;
+    if (activeSlot[voice] >= 0) {
+      const int last = active[--numActive];
+      active[activeSlot[voice]] = last;
+      activeSlot[last] = activeSlot[voice];
+      activeSlot[voice] = -1;
+    }
+  } else if (activeSlot[voice] < 0) {
+    activeSlot[voice] = numActive;
+    active[numActive++] = voice;
+  }
+}
+
+void VoiceAllocator::setNote(int voice, int part, int note) {
+  clearNote(voice);
+  const int key = part * 128 + note;
+  if (notes[key] >= 0) {
+    voiceNote[notes[key]] = -1;
+  }
+  notes[key] = voice;
+  voiceNote[voice] = key;
+}
+
+void VoiceAllocator::clearNote(int voice) {
+  if (voiceNote[voice] >= 0) {
+    notes[voiceNote[voice]] = -1;
+    voiceNote[voice] = -1;
+  }
+}
+
+//==============================================================================
+// The note map follows from voiceNote, so it is not saved.
+void VoiceAllocator::saveState(StateWriter &writer) const {
+  for (const auto *v : {&heads, &tails, &prev, &next, &voiceList, &active,
+                        &activeSlot, &voiceNote}) {
+    writer.write(v->data(), v->size());
+  }
+  writer.write(numActive);
+  writer.write(numFree);
+}
+
+bool VoiceAllocator::loadState(StateReader &reader) {
+  for (auto *v : {&heads, &tails, &prev, &next, &voiceList, &active,
+                  &activeSlot, &voiceNote}) {
+    if (!reader.read(v->data(), v->size())) {
+      return false;
+    }
+  }
+  if (!reader.read(numActive) || !reader.read(numFree) || !isConsistent()) {
+    return false;
+  }
+  std::fill(notes.begin(), notes.end(), -1);
+  for (int v = 0; v < (int)voiceNote.size(); v++) {
+    if (voiceNote[v] >= 0) {
+      if (notes[voiceNote[v]] >= 0) {
+        return false; // Two voices for one note.
+      }
+      notes[voiceNote[v]] = v;
+    }
+  }
+  return true;
+}
+
+static bool isIndex(int index, int size) {
+  return index >= 0 && index < size;
+}
+
+// Every list runs from its head to its tail through the links of its own
+// voices, together they hold each voice once, and active holds exactly the
+// voices outside the free list.
+bool VoiceAllocator::isConsistent() const {
+  const int numVoices = (int)voiceList.size();
+  const int numLists = (int)heads.size();
+  auto isLink = [numVoices](int v) { return v >= -1 && v < numVoices; };
+  for (int v = 0; v < numVoices; v++) {
+    if (!isLink(prev[v]) || !isLink(next[v]) ||
+        !isIndex(voiceList[v], numLists) ||
+        voiceNote[v] < -1 || voiceNote[v] >= (int)notes.size()) {
+      return false;
+    }
+  }
+
+  int numListed = 0, numFreeListed = 0;
+  for (int list = 0; list < numLists; list++) {
+    int last = -1;
+    for (int v = heads[list]; v != -1; v = next[v]) {
+      if (!isIndex(v, numVoices) || voiceList[v] != list ||
+          prev[v] != last || ++numListed > numVoices) {
+        return false;
+      }
+      numFreeListed += list == freeList;
+      last = v;
+    }
+    if (tails[list] != last) {
+      return false;
+    }
+  }
+  if (numListed != numVoices || numFree != numFreeListed ||
+      numActive != numVoices - numFree) {
+    return false;
+  }
+
+  for (int v = 0; v < numVoices; v++) {
+    const int slot = activeSlot[v];
+    if (voiceList[v] == freeList
+            ? slot != -1
+            : !isIndex(slot, numActive) || active[slot] != v) {
+      return false;
+    }
+  }
+  return true;
+}
@@ -0,0 +1,66 @@
+/*
+  ==============================================================================
+
+    Voice bookkeeping: which voices are free, held, sustained or releasing,
+    and which voice plays a given note.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include "EngineState.h"
+#include <vector>
+
+// Every voice sits in exactly one list. The lists are doubly linked through
+// per-voice links and append at the tail, so moving a voice is O(1) and each
+// list runs from the oldest entry to the newest. Voices outside the free list
+// are also kept in a packed array in no particular order for rendering.
+class VoiceAllocator {
+public:
+  enum List {
+    freeList,
+    heldList,      // Key down.
+    releasingList, // Gate closed, envelopes running down.
+    firstSustainedList // Key up but held by the pedal, one list per part.
+  };
+
+  // Puts every voice in the free list. Allocates, call while not processing.
+  void setSize(int numVoices, int numParts);
+
+  const int *getActiveVoices() const { return active.data(); }
+  int getNumActive() const { return numActive; }
+  int getNumFree() const { return numFree; }
+
+  List getList(int voice) const { return (List)voiceList[voice]; }
+  int getFirst(int list) const { return heads[list]; }
+  int getNext(int voice) const { return next[voice]; } // -1 at the end
+
+  void moveTo(int voice, int list);
+
+  // Note map, at most one voice per part and note. -1 if none.
+  int findNote(int part, int note) const { return notes[part * 128 + note]; }
+  void setNote(int voice, int part, int note);
+  void clearNote(int voice);
+
+  // Lists and note map, for engine snapshots. The allocator must have the
+  // same size as the saved one. loadState() returns false for a state with
+  // an index out of range or lists that don't hold every voice exactly once,
+  // and leaves the allocator unusable then: load into a spare one.
+  void saveState(StateWriter &writer) const;
+  bool loadState(StateReader &reader);
+
+private:
+  void unlink(int voice);
+  bool isConsistent() const;
+
+  std::vector<int> heads, tails;     // Per list.
+  std::vector<int> prev, next;       // Per voice.
+  std::vector<int> voiceList;        // List each voice is in.
+  std::vector<int> active;           // Voices not in the free list.
+  std::vector<int> activeSlot;       // Index in active, -1 when free.
+  std::vector<int> notes;            // [part * 128 + note] -> voice
+  std::vector<int> voiceNote;        // Key in notes per voice, -1 if none.
+  int numActive = 0;
+  int numFree = 0;
+};
@@ -0,0 +1,130 @@
+/*
+  ==============================================================================
+
+    Worker threads for splitting one render call into parallel jobs.
+
+  ==============================================================================
+*/
+
+#include "WorkerPool.h"
+#include "FMKernels.h"
+#include <thread>
+
+#if FM_KERNELS_X86
+#include <immintrin.h>
+#endif
+
+// About 50-100 us of polling before a worker goes to sleep.
+static constexpr int spinIterations = 2048;
+
+static inline void cpuRelax() {
+#if FM_KERNELS_X86
+  _mm_pause();
+#elif defined(__aarch64__) || defined(__arm__)
+  __asm__ __volatile__("yield");
+#endif
+}
+
+static constexpr uint64_t jobIndexMask = 0xFFFF;
+static constexpr int jobCountShift = 16;
+static constexpr int generationShift = 32;
+
+class WorkerPool::Worker : public juce::Thread {
+public:
+  explicit Worker(WorkerPool &p) : juce::Thread("GS1 worker"), pool(p) {}
+  void run() override { pool.workerLoop(); }
+
+private:
+  WorkerPool &pool;
+};
+
+WorkerPool::WorkerPool(int numThreads, bool realtime) {
+  threads.reserve(numThreads);
+  for (int i = 0; i < numThreads; i++) {
+    threads.push_back(std::make_unique<Worker>(*this));
+    auto &thread = *threads.back();
+    // Without the rights for realtime scheduling, as high as it gets.
+    if (!realtime ||
+        !thread.startRealtimeThread(
+            juce::Thread::RealtimeOptions().withPriority(10))) {
+      thread.startThread(realtime ? juce::Thread::Priority::highest
+                                  : juce::Thread::Priority::normal);
+    }
+  }
+}
+
+WorkerPool::~WorkerPool() {
+  stop = true;
+  work.fetch_add(uint64_t(1) << generationShift);
+  work.notify_all();
+  for (auto &thread : threads) {
+    thread->waitForThreadToExit(-1);
+  }
+}
+
+void WorkerPool::run(int numJobs, void (*function)(void *, int),
+                     void *context) {
+  jobFunction = function;
+  jobContext = context;
+  jobsDone.store(0, std::memory_order_relaxed);
+
+  const uint64_t generation =
+      (work.load(std::memory_order_relaxed) >> generationShift) + 1;
+  work.store((generation << generationShift) |
+             (uint64_t(numJobs) << jobCountShift));
+  if (numParked.load() > 0) {
+    work.notify_all();
+  }
+
+  runJobs();
+  // Only jobs a worker is running are left. If that worker shares the core
+  // with the caller, spinning on would keep it from finishing.
+  for (int i = 0; jobsDone.load(std::memory_order_acquire) < numJobs; i++) {
+    if (i < spinIterations) {
+      cpuRelax();
+    } else {
+      std::this_thread::yield();
+    }
+  }
+}
+
+uint64_t WorkerPool::runJobs() {
+  uint64_t current = work.load(std::memory_order_acquire);
+  for (;;) {
+    const int index = int(current & jobIndexMask);
+    const int numJobs = int((current >> jobCountShift) & jobIndexMask);
+    if (index >= numJobs) {
+      return current;
+    }
+    if (work.compare_exchange_weak(current, current + 1,
+                                   std::memory_order_acq_rel)) {
+      jobFunction(jobContext, index);
+      jobsDone.fetch_add(1, std::memory_order_release);
+      current = work.load(std::memory_order_acquire);
+    }
+  }
+}
+
+void WorkerPool::workerLoop() {
+  uint64_t seen = work.load();
+  while (!stop) {
+    bool changed = false;
+    for (int i = 0; i < spinIterations && !changed; i++) {
+      changed = work.load(std::memory_order_relaxed) != seen;
+      cpuRelax();
+    }
+    if (!changed) {
+      // run() checks numParked after publishing, so either it sees this
+      // worker parked or the wait sees the new word.
+      numParked.fetch_add(1);
+      work.wait(seen);
+      numParked.fetch_sub(1);
+    }
+    if (stop) {
+      return;
+    }
+    // Waking on the word that had no jobs left means a later run() is never
+    // missed.
+    seen = runJobs();
+  }
+}
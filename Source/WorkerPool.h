@@ -0,0 +1,66 @@
+/*
+  ==============================================================================
+
+    Worker threads for splitting one render call into parallel jobs.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+// A fixed set of threads that run jobs handed out by run(). Dispatch is a
+// single atomic word the workers claim job indices from, so run() takes no
+// locks and allocates nothing and can be called from the audio thread. Idle
+// workers spin for a short while before parking, which keeps the wake-up
+// cheap between calls made within one audio block. Realtime workers run at
+// audio priority, so one that took a job is not preempted by the rest of the
+// system while the caller waits for it.
+class WorkerPool {
+public:
+  explicit WorkerPool(int numThreads, bool realtime = false);
+  ~WorkerPool();
+
+  int getNumThreads() const { return (int)threads.size(); }
+
+  // Calls job(index) for every index in [0, numJobs) and returns once all of
+  // them are done. The calling thread takes every job no worker has claimed
+  // yet, so more jobs than threads leave little to wait for when a worker
+  // wakes late. Not reentrant.
+  template <class Job> void run(int numJobs, Job &job) {
+    run(numJobs,
+        [](void *context, int index) { (*static_cast<Job *>(context))(index); },
+        &job);
+  }
+
+  void run(int numJobs, void (*function)(void *, int), void *context);
+
+  static constexpr int maxJobs = 0xFFFF;
+
+private:
+  class Worker;
+
+  void workerLoop();
+  uint64_t runJobs(); // Returns the word once no job is left.
+
+  // Bits 0-15: next job index, 16-31: number of jobs, 32-63: generation. One
+  // word so a worker never claims an index against the count of another call.
+  std::atomic<uint64_t> work{0};
+  std::atomic<int> jobsDone{0};
+  std::atomic<int> numParked{0};
+  std::atomic<bool> stop{false};
+
+  // Written before the generation is published, stable while jobs remain.
+  void (*jobFunction)(void *, int) = nullptr;
+  void *jobContext = nullptr;
+
+  std::vector<std::unique_ptr<Worker>> threads;
+
+  WorkerPool(const WorkerPool &) = delete;
+  WorkerPool &operator=(const WorkerPool &) = delete;
+};
@@ -0,0 +1,7 @@
+ROOT=$(cd "$(dirname "$0")/.."; pwd)
+
+# Resave jucer files
+"$ROOT/build/bin/JUCE/Projucer" --resave "$ROOT/gs1-headless.jucer"
+
+cd "$ROOT/Builds/Headless/LinuxMakefile"
+make CONFIG=Release -j"$(nproc)" || exit 1